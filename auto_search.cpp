@@ -1,82 +1,1010 @@
 #include <bits/stdc++.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 using namespace std;
 
-class SearchAutocomplete {
+// ---------------- On-disk autocomplete image ----------------
+// Flattened trie in BFS order, so a node's children are consecutive nodes.
+// Every reference is an index or an offset: the file is mapped and served
+// as is.
+struct AutocompleteImageHeader {
+    char magic[8];              // "ACIMG002"
+    uint32_t nodeCount;
+    uint32_t sentenceCount;
+    uint64_t nodesOff;          // AutocompleteImageNode[nodeCount]
+    uint64_t firstBytesOff;     // uint8_t[nodeCount], first label byte per node
+    uint64_t sentencesOff;      // AutocompleteImageSentence[sentenceCount]
+    uint64_t textOff;           // labels and sentences
+    uint64_t textLen;
+    uint32_t infix;             // 1 if built with AutocompleteIndex::setInfix
+    uint32_t pad;
+};
+
+struct AutocompleteImageNode {
+    uint64_t labelOff;
+    uint32_t labelLen;
+    uint32_t childBegin;        // children are nodes [childBegin, childBegin + childCount)
+    uint32_t childCount;
+    uint32_t sentence;          // sentence ending here, UINT32_MAX if none
+    uint32_t topCount;
+    uint32_t topIds[3];         // AutocompleteIndex::TOP_K, best first
+    double topScores[3];
+};
+
+struct AutocompleteImageSentence {
+    uint64_t off;
+    uint32_t len;
+    uint32_t pad;
+    double score;
+};
+
+// Sentence trie with per-node top lists. Holds no per-user state: a typing
+// position is a (node, depth) cursor owned by the caller.
+class AutocompleteIndex {
+public:
+    static constexpr int TOP_K = 3;
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    uint64_t generation = 0;            // bumped by every insert; cursors from
+                                        // an older generation must be re-walked
 private:
+    // Scores decay exponentially at `rate` per second. Rather than touching
+    // every score as time passes, a count added at time t is stored boosted
+    // by e^(rate (t - epoch)): all stored scores share the same scale at any
+    // moment, so their order, and every top list, stays valid as they age.
+    // Scores are rescaled to a new epoch before the boost can overflow.
+    static constexpr double MAX_BOOST = 1e100;
+    double rate = 0;                    // 0: plain counts, no decay
+    double epoch = 0;
+    bool infix = false;                 // see setInfix
+
+    // Every distinct sentence is stored once, in `text`, and referred to by id
+    struct Sentence {
+        uint32_t off;
+        uint32_t len;
+        double score;                   // boosted, see above
+    };
+
+    // Radix trie node. Edge labels are slices of `text`, so a sentence's
+    // unshared tail costs one node and no extra bytes.
     struct TrieNode {
-        unordered_map<char, TrieNode*> children;
-        unordered_map<string, int> freqMap;   // sentence -> frequency
+        uint32_t labelOff = 0;
+        uint32_t labelLen = 0;
+        uint32_t sentence = NONE;       // sentence ending here
+        uint32_t topCount = 0;
+        uint32_t topIds[TOP_K];         // best sentences below, best first
+        uint32_t suffixes = NONE;       // infix entries ending here, see suffixLists
+        double topScores[TOP_K];
+        vector<uint64_t> children;      // (first label byte << 32 | node), sorted
     };
 
-    TrieNode* root;
-    string currentInput;
+    string text;
+    vector<Sentence> sentences;
+    vector<TrieNode> nodes;             // nodes[0] is the root
+    vector<vector<uint32_t>> suffixLists;   // sentences whose word-start suffix ends at a node
+    vector<uint32_t> path;              // scratch for insert
 
-public:
-    SearchAutocomplete(vector<string>& phrases, vector<int>& counts) {
-        root = new TrieNode();
-        currentInput = "";
+    string_view sentenceText(uint32_t id) const {
+        return string_view(text).substr(sentences[id].off, sentences[id].len);
+    }
 
-        for (int i = 0; i < phrases.size(); i++) {
-            insert(phrases[i], counts[i]);
+    // Higher score first, ties in ASCII order
+    bool better(uint32_t a, double scoreA, uint32_t b, double scoreB) const {
+        if (scoreA != scoreB) return scoreA > scoreB;
+        return sentenceText(a) < sentenceText(b);
+    }
+
+    uint32_t findChild(uint32_t node, unsigned char c) const {
+        const vector<uint64_t>& ch = nodes[node].children;
+        auto it = lower_bound(ch.begin(), ch.end(), (uint64_t)c << 32);
+        return (it != ch.end() && (*it >> 32) == c) ? (uint32_t)*it : NONE;
+    }
+
+    void setChild(uint32_t node, uint32_t child) {
+        uint64_t key = (uint64_t)(unsigned char)text[nodes[child].labelOff] << 32;
+        vector<uint64_t>& ch = nodes[node].children;
+        auto it = lower_bound(ch.begin(), ch.end(), key);
+        if (it != ch.end() && (*it >> 32) == (key >> 32)) *it = key | child;
+        else ch.insert(it, key | child);
+    }
+
+    uint32_t newNode(uint32_t off, uint32_t len) {
+        nodes.emplace_back();
+        nodes.back().labelOff = off;
+        nodes.back().labelLen = len;
+        return nodes.size() - 1;
+    }
+
+    uint32_t intern(const string& sentence) {
+        if (text.size() + sentence.size() > UINT32_MAX) throw length_error("sentence text over 4 GB");
+        sentences.push_back({(uint32_t)text.size(), (uint32_t)sentence.size(), 0});
+        text += sentence;
+        return sentences.size() - 1;
+    }
+
+    // Walk key down the trie, creating what is missing; key is stored in
+    // text at keyOff, so new labels can point there. path receives every
+    // node below the root. Returns the node where key ends.
+    uint32_t descend(string_view key, uint32_t keyOff) {
+        uint32_t node = 0;
+        size_t i = 0;
+        path.clear();
+        while (i < key.size()) {
+            uint32_t child = findChild(node, key[i]);
+            if (child == NONE) {
+                child = newNode(keyOff + i, key.size() - i);
+                setChild(node, child);
+                path.push_back(child);
+                node = child;
+                break;
+            }
+
+            uint32_t k = 0, len = nodes[child].labelLen;
+            while (k < len && i + k < key.size() &&
+                   text[nodes[child].labelOff + k] == key[i + k]) k++;
+            if (k < len) {
+                // split: the first k bytes become a new parent of child
+                uint32_t mid = newNode(nodes[child].labelOff, k);
+                TrieNode& c = nodes[child];
+                TrieNode& m = nodes[mid];
+                c.labelOff += k;
+                c.labelLen -= k;
+                m.topCount = c.topCount;
+                copy(c.topIds, c.topIds + c.topCount, m.topIds);
+                copy(c.topScores, c.topScores + c.topCount, m.topScores);
+                m.children.push_back((uint64_t)(unsigned char)text[c.labelOff] << 32 | child);
+                setChild(node, mid);    // same first byte: replaces child
+                child = mid;
+            }
+            path.push_back(child);
+            node = child;
+            i += k;
         }
+
+        return node;
     }
 
-    // Insert sentence into Trie, updating frequency
-    void insert(const string& sentence, int count) {
-        TrieNode* node = root;
+    // Raise id along path, or after a drop rebuild it bottom-up (the drop
+    // can let another sentence in)
+    void updateTops(uint32_t id, double delta) {
+        if (delta >= 0) {
+            for (uint32_t node : path) raise(node, id);
+        } else {
+            for (size_t i = path.size(); i-- > 0;) rebuild(path[i]);
+        }
+    }
 
-        for (char c : sentence) {
-            if (!node->children.count(c)) {
-                node->children[c] = new TrieNode();
+    // Keep a node's top list sorted after sentence id's score went up
+    void raise(uint32_t node, uint32_t id) {
+        TrieNode& n = nodes[node];
+        double score = sentences[id].score;
+        uint32_t i = find(n.topIds, n.topIds + n.topCount, id) - n.topIds;
+        if (i == n.topCount) {
+            if (n.topCount == TOP_K) {
+                if (!better(id, score, n.topIds[TOP_K - 1], n.topScores[TOP_K - 1])) return;
+                i--;
+            } else {
+                n.topCount++;
             }
-            node = node->children[c];
+            n.topIds[i] = id;
+        }
+        n.topScores[i] = score;
+        for (; i > 0 && better(n.topIds[i], n.topScores[i], n.topIds[i - 1], n.topScores[i - 1]); i--) {
+            swap(n.topIds[i], n.topIds[i - 1]);
+            swap(n.topScores[i], n.topScores[i - 1]);
+        }
+    }
+
+    void addSuffix(uint32_t node, uint32_t id) {
+        TrieNode& n = nodes[node];
+        if (n.suffixes == NONE) {
+            n.suffixes = suffixLists.size();
+            suffixLists.emplace_back();
+        }
+        vector<uint32_t>& list = suffixLists[n.suffixes];
+        if (find(list.begin(), list.end(), id) == list.end()) list.push_back(id);
+    }
+
+    // Recompute a node's top list from the sentences and infix entries ending
+    // here and its children's lists (any sentence in the node's top K is in
+    // some child's top K). With infix on, one sentence can reach a node along
+    // several suffixes, so candidates are deduplicated by id.
+    void rebuild(uint32_t node) {
+        vector<pair<uint32_t, double>> cand;
+        TrieNode& n = nodes[node];
+        if (n.sentence != NONE) cand.push_back({n.sentence, sentences[n.sentence].score});
+        if (n.suffixes != NONE)
+            for (uint32_t id : suffixLists[n.suffixes]) cand.push_back({id, sentences[id].score});
+        for (uint64_t c : n.children) {
+            const TrieNode& child = nodes[(uint32_t)c];
+            for (uint32_t j = 0; j < child.topCount; j++)
+                cand.push_back({child.topIds[j], child.topScores[j]});
+        }
+        sort(cand.begin(), cand.end(), [&](auto& a, auto& b) {
+            return better(a.first, a.second, b.first, b.second);
+        });
+        cand.erase(unique(cand.begin(), cand.end(), [](auto& a, auto& b) { return a.first == b.first; }),
+                   cand.end());
+
+        n.topCount = min<size_t>(cand.size(), TOP_K);
+        for (size_t j = 0; j < n.topCount; j++) {
+            n.topIds[j] = cand[j].first;
+            n.topScores[j] = cand[j].second;
+        }
+    }
+
+public:
+    AutocompleteIndex() {
+        nodes.emplace_back();   // root
+    }
+
+    // Drop growth slack, e.g. after the initial load
+    void shrink() {
+        text.shrink_to_fit();
+        sentences.shrink_to_fit();
+        nodes.shrink_to_fit();
+        suffixLists.shrink_to_fit();
+    }
+
+    double boost(double now) const {
+        return exp(rate * (now - epoch));
+    }
+
+    // Move the epoch to now, dividing every stored score by its boost
+    void renormalize(double now) {
+        double b = boost(now);
+        for (Sentence& s : sentences) s.score /= b;
+        for (TrieNode& n : nodes)
+            for (uint32_t j = 0; j < n.topCount; j++) n.topScores[j] /= b;
+        epoch = now;
+    }
 
-            node->freqMap[sentence] += count;
+    // Add an already boosted amount to sentence's score
+    void addScore(const string& sentence, double delta) {
+        generation++;
+        uint32_t id = lookup(sentence);
+        if (id == NONE) {
+            id = intern(sentence);
+            nodes[descend(sentence, sentences[id].off)].sentence = id;
+        } else {
+            descend(sentence, sentences[id].off);
+        }
+        sentences[id].score += delta;
+        updateTops(id, delta);
+
+        // infix: every later word start also leads to the whole sentence
+        for (size_t p = 1; infix && p < sentence.size(); p++) {
+            if (sentence[p - 1] != ' ' || sentence[p] == ' ') continue;
+            addSuffix(descend(string_view(sentence).substr(p), sentences[id].off + p), id);
+            updateTops(id, delta);
         }
     }
 
-    // Get top 3 sentences from freqMap
-    vector<string> top3(unordered_map<string, int>& freqMap) {
-        // Min-heap: lowest freq at top
-        auto cmp = [&](const string& a, const string& b) {
-            if (freqMap[a] != freqMap[b])
-                return freqMap[a] > freqMap[b];  // smaller freq first
-            return a < b; // reverse ASCII for tie
-        };
+    // Also index sentences from each word start, not just from the start.
+    // Existing sentences are re-indexed.
+    void setInfix(bool on, double now) {
+        if (on == infix) return;
+        infix = on;
+        compact(now, -numeric_limits<double>::infinity());
+    }
 
-        priority_queue<string, vector<string>, decltype(cmp)> pq(cmp);
+    // Decay scores with the given half-life from `now` on (0 turns it off)
+    void setHalfLife(double seconds, double now) {
+        renormalize(now);
+        rate = seconds > 0 ? log(2.0) / seconds : 0;
+    }
 
-        for (auto& p : freqMap) {
-            pq.push(p.first);
-            if (pq.size() > 3)
-                pq.pop();
+    // Insert sentence into Trie, adding count at time now (seconds)
+    void insert(const string& sentence, int count, double now = 0) {
+        if (boost(now) > MAX_BOOST) renormalize(now);
+        addScore(sentence, count * boost(now));
+    }
+
+    // Rebuild from the sentences whose decayed score is still at least
+    // `threshold`, with fresh top lists, no dead text and the epoch at now
+    void compact(double now, double threshold) {
+        AutocompleteIndex fresh;
+        fresh.rate = rate;
+        fresh.epoch = now;
+        fresh.infix = infix;
+        double b = boost(now);
+        for (uint32_t id = 0; id < sentences.size(); id++) {
+            double score = sentences[id].score / b;
+            if (score >= threshold) fresh.addScore(string(sentenceText(id)), score);
         }
+        fresh.shrink();
+        fresh.generation = generation + 1;
+        *this = std::move(fresh);
+    }
 
+    // Top 3 of a node, already maintained by insert: O(k)
+    vector<string> top3(uint32_t node) const {
         vector<string> result;
-        while (!pq.empty()) {
-            result.push_back(pq.top());
-            pq.pop();
+        const TrieNode& n = nodes[node];
+        for (uint32_t j = 0; j < n.topCount; j++) result.emplace_back(sentenceText(n.topIds[j]));
+        return result;
+    }
+
+    // Advance a cursor by one byte, inside a label or onto a child; node
+    // becomes NONE on a miss
+    void step(uint32_t& node, uint32_t& depth, char ch) const {
+        const TrieNode& n = nodes[node];
+        if (depth < n.labelLen) {
+            if (text[n.labelOff + depth] == ch) depth++;
+            else node = NONE;
+        } else {
+            node = findChild(node, ch);
+            depth = 1;
         }
-        reverse(result.begin(), result.end());  // highest freq first
+    }
+
+    // Cursor for a whole prefix, from the root
+    void walk(const string& prefix, uint32_t& node, uint32_t& depth) const {
+        node = 0;
+        depth = 0;
+        for (size_t i = 0; i < prefix.size() && node != NONE; i++) step(node, depth, prefix[i]);
+    }
+
+    // Id of an exact sentence, NONE if absent
+    uint32_t lookup(string_view sentence) const {
+        uint32_t node = 0, depth = 0;
+        for (size_t i = 0; i < sentence.size() && node != NONE; i++) step(node, depth, sentence[i]);
+        return node != NONE && depth == nodes[node].labelLen ? nodes[node].sentence : NONE;
+    }
+
+    bool contains(string_view sentence) const {
+        return lookup(sentence) != NONE;
+    }
+
+    // Call f(byte, node, depth) for each position one byte below a cursor
+    template <class F>
+    void forEachNext(uint32_t node, uint32_t depth, F&& f) const {
+        const TrieNode& n = nodes[node];
+        if (depth < n.labelLen) {
+            f((unsigned char)text[n.labelOff + depth], node, depth + 1);
+            return;
+        }
+        for (uint64_t c : n.children) f((unsigned char)(c >> 32), (uint32_t)c, 1);
+    }
+
+    // Top list of a node with the stored scores
+    vector<pair<string_view, double>> topScored(uint32_t node) const {
+        vector<pair<string_view, double>> result;
+        const TrieNode& n = nodes[node];
+        for (uint32_t j = 0; j < n.topCount; j++) result.push_back({sentenceText(n.topIds[j]), n.topScores[j]});
         return result;
     }
 
-    vector<string> getSuggestions(char ch) {
+    // Flatten into an image for MappedAutocompleteIndex, scores decayed to now
+    void saveImage(const string& path, double now = 0) const {
+        double b = boost(now);
+
+        // BFS so that each node's children get consecutive ids
+        vector<uint32_t> order{0};
+        vector<AutocompleteImageNode> out;
+        vector<uint8_t> firstBytes;
+        for (size_t head = 0; head < order.size(); head++) {
+            const TrieNode& n = nodes[order[head]];
+            AutocompleteImageNode img{n.labelOff, n.labelLen, (uint32_t)order.size(),
+                                      (uint32_t)n.children.size(), n.sentence, n.topCount, {}, {}};
+            for (uint32_t j = 0; j < n.topCount; j++) {
+                img.topIds[j] = n.topIds[j];
+                img.topScores[j] = n.topScores[j] / b;
+            }
+            out.push_back(img);
+            firstBytes.push_back(head ? text[n.labelOff] : 0);
+            for (uint64_t c : n.children) order.push_back((uint32_t)c);
+        }
+
+        vector<AutocompleteImageSentence> sents;
+        for (const Sentence& st : sentences) sents.push_back({st.off, st.len, 0, st.score / b});
+
+        auto align8 = [](uint64_t x) { return (x + 7) & ~7ull; };
+        AutocompleteImageHeader h{};
+        memcpy(h.magic, "ACIMG002", 8);
+        h.nodeCount = out.size();
+        h.sentenceCount = sents.size();
+        h.nodesOff = align8(sizeof(h));
+        h.sentencesOff = h.nodesOff + out.size() * sizeof(AutocompleteImageNode);
+        h.firstBytesOff = h.sentencesOff + sents.size() * sizeof(AutocompleteImageSentence);
+        h.textOff = h.firstBytesOff + firstBytes.size();
+        h.textLen = text.size();
+        h.infix = infix;
+
+        string file(h.textOff + text.size(), '\0');
+        memcpy(&file[0], &h, sizeof(h));
+        memcpy(&file[h.nodesOff], out.data(), out.size() * sizeof(AutocompleteImageNode));
+        memcpy(&file[h.sentencesOff], sents.data(), sents.size() * sizeof(AutocompleteImageSentence));
+        memcpy(&file[h.firstBytesOff], firstBytes.data(), firstBytes.size());
+        memcpy(&file[h.textOff], text.data(), text.size());
+
+        ofstream f(path, ios::binary | ios::trunc);
+        f.write(file.data(), file.size());
+        if (!f) throw runtime_error("cannot write autocomplete image " + path);
+    }
+
+    // Approximate heap footprint divided by the number of distinct sentences
+    double bytesPerSentence() const {
+        size_t bytes = text.capacity() + sentences.capacity() * sizeof(Sentence) +
+                       nodes.capacity() * sizeof(TrieNode);
+        for (const TrieNode& n : nodes) bytes += n.children.capacity() * sizeof(uint64_t);
+        return sentences.empty() ? 0.0 : (double)bytes / sentences.size();
+    }
+};
+
+// Read-only index served straight from an mmap-ed image: no parsing at
+// startup, no allocation per lookup beyond the result
+class MappedAutocompleteIndex {
+private:
+    const char* base = nullptr;
+    size_t length = 0;
+    const AutocompleteImageHeader* header;
+    const AutocompleteImageNode* nodes;
+    const uint8_t* firstBytes;
+    const AutocompleteImageSentence* sentences;
+    const char* text;
+
+    uint32_t findChild(const AutocompleteImageNode& n, unsigned char c) const {
+        const uint8_t* b = firstBytes + n.childBegin;
+        const uint8_t* e = b + n.childCount;
+        const uint8_t* it = lower_bound(b, e, c);
+        return (it != e && *it == c) ? (uint32_t)(it - firstBytes) : AutocompleteIndex::NONE;
+    }
+
+    string_view sentenceText(uint32_t id) const {
+        return string_view(text + sentences[id].off, sentences[id].len);
+    }
+
+public:
+    explicit MappedAutocompleteIndex(const string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw runtime_error("cannot open autocomplete image " + path);
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(AutocompleteImageHeader)) {
+            close(fd);
+            throw runtime_error("bad autocomplete image " + path);
+        }
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) throw runtime_error("cannot map autocomplete image " + path);
+
+        base = (const char*)p;
+        length = st.st_size;
+        header = (const AutocompleteImageHeader*)base;
+        if (memcmp(header->magic, "ACIMG002", 8) != 0 || header->nodeCount == 0 ||
+            header->textOff + header->textLen > length)
+        {
+            munmap(p, length);
+            throw runtime_error("bad autocomplete image " + path);
+        }
+
+        nodes = (const AutocompleteImageNode*)(base + header->nodesOff);
+        firstBytes = (const uint8_t*)(base + header->firstBytesOff);
+        sentences = (const AutocompleteImageSentence*)(base + header->sentencesOff);
+        text = base + header->textOff;
+    }
+
+    MappedAutocompleteIndex(const MappedAutocompleteIndex&) = delete;
+    MappedAutocompleteIndex& operator=(const MappedAutocompleteIndex&) = delete;
+
+    ~MappedAutocompleteIndex() { munmap((void*)base, length); }
+
+    // Same cursor moves as AutocompleteIndex::step
+    void step(uint32_t& node, uint32_t& depth, char ch) const {
+        const AutocompleteImageNode& n = nodes[node];
+        if (depth < n.labelLen) {
+            if (text[n.labelOff + depth] == ch) depth++;
+            else node = AutocompleteIndex::NONE;
+        } else {
+            node = findChild(n, ch);
+            depth = 1;
+        }
+    }
+
+    void walk(const string& prefix, uint32_t& node, uint32_t& depth) const {
+        node = 0;
+        depth = 0;
+        for (size_t i = 0; i < prefix.size() && node != AutocompleteIndex::NONE; i++) step(node, depth, prefix[i]);
+    }
+
+    template <class F>
+    void forEachNext(uint32_t node, uint32_t depth, F&& f) const {
+        const AutocompleteImageNode& n = nodes[node];
+        if (depth < n.labelLen) {
+            f((unsigned char)text[n.labelOff + depth], node, depth + 1);
+            return;
+        }
+        for (uint32_t c = n.childBegin; c < n.childBegin + n.childCount; c++) f(firstBytes[c], c, 1);
+    }
+
+    // Whether sentences are also indexed from later word starts
+    bool infix() const { return header->infix != 0; }
+
+    // Points into the mapping
+    vector<pair<string_view, double>> topScored(uint32_t node) const {
+        vector<pair<string_view, double>> result;
+        const AutocompleteImageNode& n = nodes[node];
+        for (uint32_t j = 0; j < n.topCount; j++) result.push_back({sentenceText(n.topIds[j]), n.topScores[j]});
+        return result;
+    }
+
+    // Score of an exact sentence, 0 if absent
+    double score(string_view sentence) const {
+        uint32_t node = 0, depth = 0;
+        for (size_t i = 0; i < sentence.size() && node != AutocompleteIndex::NONE; i++) step(node, depth, sentence[i]);
+        if (node == AutocompleteIndex::NONE || depth != nodes[node].labelLen) return 0;
+        uint32_t id = nodes[node].sentence;
+        return id == AutocompleteIndex::NONE ? 0 : sentences[id].score;
+    }
+};
+
+// ---------------- Fuzzy prefix matching ----------------
+// Levenshtein automaton run over the trie. The state after some input is
+// its frontier: every trie position whose path is within maxEdits of the
+// input, with the smallest such distance. A keystroke only expands the
+// current frontier, which is capped, so it costs bounded work whatever the
+// input length. Works on any index with forEachNext and topScored.
+struct FuzzyState {
+    uint32_t node;
+    uint32_t depth;
+    uint32_t edits;
+};
+
+template <class Index>
+struct FuzzyMatcher {
+    static constexpr size_t FRONTIER_LIMIT = 256;
+
+    // Frontier for empty input
+    static void start(const Index& index, uint32_t maxEdits, vector<FuzzyState>& frontier) {
+        frontier.assign(1, {0, 0, 0});
+        close(index, maxEdits, frontier);
+    }
+
+    static void advance(const Index& index, uint32_t maxEdits, char ch, vector<FuzzyState>& frontier) {
+        vector<FuzzyState> next;
+        for (const FuzzyState& s : frontier) {
+            if (s.edits < maxEdits) next.push_back({s.node, s.depth, s.edits + 1});   // ch is extra
+            index.forEachNext(s.node, s.depth, [&](unsigned char b, uint32_t node, uint32_t depth) {
+                uint32_t edits = s.edits + (b != (unsigned char)ch);                 // match or substitute
+                if (edits <= maxEdits) next.push_back({node, depth, edits});
+            });
+        }
+        frontier.swap(next);
+        close(index, maxEdits, frontier);
+    }
+
+    static void run(const Index& index, uint32_t maxEdits, const string& input, vector<FuzzyState>& frontier) {
+        start(index, maxEdits, frontier);
+        for (char ch : input) advance(index, maxEdits, ch, frontier);
+    }
+
+    // (edits, score, sentence) for every top entry reachable from the frontier
+    static void candidates(const Index& index, const vector<FuzzyState>& frontier,
+                           vector<tuple<uint32_t, double, string_view>>& out) {
+        for (const FuzzyState& s : frontier)
+            for (auto& [sentence, score] : index.topScored(s.node)) out.push_back({s.edits, score, sentence});
+    }
+
+private:
+    // Add trie bytes the input skipped, keep the best distance per position
+    // and cap the frontier, closest positions first
+    static void close(const Index& index, uint32_t maxEdits, vector<FuzzyState>& frontier) {
+        for (size_t i = 0; i < frontier.size(); i++) {
+            FuzzyState s = frontier[i];
+            if (s.edits < maxEdits) {
+                index.forEachNext(s.node, s.depth, [&](unsigned char, uint32_t node, uint32_t depth) {
+                    frontier.push_back({node, depth, s.edits + 1});
+                });
+            }
+        }
+
+        sort(frontier.begin(), frontier.end(), [](auto& a, auto& b) {
+            return tie(a.node, a.depth, a.edits) < tie(b.node, b.depth, b.edits);
+        });
+        frontier.erase(unique(frontier.begin(), frontier.end(), [](auto& a, auto& b) {
+            return a.node == b.node && a.depth == b.depth;
+        }), frontier.end());
+
+        if (frontier.size() > FRONTIER_LIMIT) {
+            stable_sort(frontier.begin(), frontier.end(), [](auto& a, auto& b) { return a.edits < b.edits; });
+            frontier.resize(FRONTIER_LIMIT);
+        }
+    }
+};
+
+// Autocomplete engine serving many typing sessions at once. The index is
+// kept as two replicas under the left-right protocol: lookups are wait-free
+// and never see a half-applied insert. Sessions' '#' commits are queued and
+// applied in batches by a background thread, one replica at a time.
+//
+// Built from an image, the engine serves the mapped index and keeps only
+// live inserts in memory: the first time a sentence is touched its image
+// score is copied in, so the in-memory score is the full score and
+// supersedes the image's entry when their top lists are merged. Counts must
+// not be negative in this mode: a touched sentence then never ranks below
+// its image score, so any image entry the filter removes is replaced by an
+// in-memory one at least as good and the merge of the two lists is exact.
+class SearchAutocomplete {
+public:
+    // Per-user typing state; owned by the caller, one thread at a time
+    struct Session {
+        string input;
+        uint32_t node = 0;
+        uint32_t depth = 0;
+        uint64_t generation = 0;        // index generation the cursor belongs to
+        uint32_t imageNode = 0;         // cursor in the mapped image, if any
+        uint32_t imageDepth = 0;
+
+        uint32_t edits = 0;             // fuzzy distance the state is built for
+        vector<FuzzyState> frontier;    // with edits > 0, instead of the cursors
+        vector<FuzzyState> imageFrontier;
+    };
+
+private:
+    // Reader counter striped over cache lines to keep arrive/depart cheap
+    class ReadIndicator {
+        static constexpr int STRIPES = 32;
+        struct alignas(64) Counter { atomic<long> n{0}; };
+        Counter counters[STRIPES];
+
+        static int stripe() {
+            static thread_local int s = hash<thread::id>{}(this_thread::get_id()) % STRIPES;
+            return s;
+        }
+
+    public:
+        void arrive() { counters[stripe()].n.fetch_add(1); }
+        void depart() { counters[stripe()].n.fetch_sub(1, memory_order_release); }
+
+        bool empty() const {
+            for (auto& c : counters) if (c.n.load() != 0) return false;
+            return true;
+        }
+    };
+
+    unique_ptr<MappedAutocompleteIndex> image;
+    AutocompleteIndex replicas[2];
+    atomic<int> leftRight{0};           // replica readers use
+    atomic<int> versionIndex{0};        // read indicator new readers use
+    mutable ReadIndicator readers[2];
+    mutex writeLock;
+
+    // '#' commits waiting for the background thread, and its compaction
+    // schedule (both guarded by queueLock)
+    mutex queueLock;
+    condition_variable queueCv;
+    vector<string> pending;
+    uint64_t enqueued = 0, applied = 0;
+    bool stopping = false;
+    double pruneBelow = -numeric_limits<double>::infinity();  // set by enableDecay
+    chrono::steady_clock::duration compactEvery{0};    // 0: no periodic compaction
+    chrono::steady_clock::time_point nextCompaction;
+    thread batcher;
+
+    const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+
+    Session legacy;                     // behind the single-user getSuggestions(char)
+    atomic<uint32_t> fuzzyEdits{0};
+
+    template <class F>
+    auto read(F&& f) const {
+        int vi = versionIndex.load();
+        readers[vi].arrive();
+        auto result = f(replicas[leftRight.load()]);
+        readers[vi].depart();
+        return result;
+    }
+
+    template <class F>
+    void write(F&& f) {
+        lock_guard<mutex> guard(writeLock);
+        int lr = leftRight.load();
+        f(replicas[1 - lr]);
+        leftRight.store(1 - lr);
+
+        // wait out every reader that may still be on replica lr
+        int vi = versionIndex.load();
+        while (!readers[1 - vi].empty()) this_thread::yield();
+        versionIndex.store(1 - vi);
+        while (!readers[vi].empty()) this_thread::yield();
+
+        f(replicas[lr]);
+    }
+
+    // Seconds since construction, the time base for decay
+    double now() const {
+        return chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    }
+
+    // Add count to a sentence, first carrying over its score from the image
+    void apply(AutocompleteIndex& index, const string& sentence, int count, double t) const {
+        if (image && !index.contains(sentence)) {
+            double s = image->score(sentence);
+            if (s != 0) index.addScore(sentence, s);
+        }
+        index.insert(sentence, count, t);
+    }
+
+    vector<string> merged(const AutocompleteIndex& index, const Session& session) const {
+        vector<pair<string_view, double>> cand;
+        if (session.node != AutocompleteIndex::NONE) cand = index.topScored(session.node);
+        if (session.imageNode != AutocompleteIndex::NONE) {
+            for (auto& e : image->topScored(session.imageNode))
+                if (!index.contains(e.first)) cand.push_back(e);
+        }
+        sort(cand.begin(), cand.end(), [](auto& a, auto& b) {
+            if (a.second != b.second) return a.second > b.second;
+            return a.first < b.first;
+        });
+
+        vector<string> result;
+        for (size_t j = 0; j < cand.size() && j < AutocompleteIndex::TOP_K; j++) result.emplace_back(cand[j].first);
+        return result;
+    }
+
+    vector<string> fuzzySuggestions(Session& session, char ch, uint32_t maxEdits) const {
+        bool restart = session.edits != maxEdits;
+        session.edits = maxEdits;
+        if (image) {
+            if (restart) FuzzyMatcher<MappedAutocompleteIndex>::run(*image, maxEdits, session.input, session.imageFrontier);
+            else FuzzyMatcher<MappedAutocompleteIndex>::advance(*image, maxEdits, ch, session.imageFrontier);
+        }
+
+        return read([&](const AutocompleteIndex& index) {
+            if (restart || session.generation != index.generation) {
+                session.generation = index.generation;
+                FuzzyMatcher<AutocompleteIndex>::run(index, maxEdits, session.input, session.frontier);
+            } else {
+                FuzzyMatcher<AutocompleteIndex>::advance(index, maxEdits, ch, session.frontier);
+            }
+
+            vector<tuple<uint32_t, double, string_view>> cand, fromImage;
+            FuzzyMatcher<AutocompleteIndex>::candidates(index, session.frontier, cand);
+            if (image) {
+                FuzzyMatcher<MappedAutocompleteIndex>::candidates(*image, session.imageFrontier, fromImage);
+                for (auto& c : fromImage)
+                    if (!index.contains(get<2>(c))) cand.push_back(c);
+            }
+
+            // closest first, then by score and text; a sentence reached at
+            // several distances counts once
+            sort(cand.begin(), cand.end(), [](auto& a, auto& b) {
+                if (get<0>(a) != get<0>(b)) return get<0>(a) < get<0>(b);
+                if (get<1>(a) != get<1>(b)) return get<1>(a) > get<1>(b);
+                return get<2>(a) < get<2>(b);
+            });
+            vector<string> result;
+            for (auto& c : cand) {
+                if (result.size() == AutocompleteIndex::TOP_K) break;
+                if (find(result.begin(), result.end(), get<2>(c)) == result.end()) result.emplace_back(get<2>(c));
+            }
+            return result;
+        });
+    }
+
+    // Run an expensive rebuild once, on the idle replica, then copy it over
+    template <class F>
+    void rebuildIndex(F&& rebuild) {
+        AutocompleteIndex* done = nullptr;
+        write([&](AutocompleteIndex& index) {
+            if (done) {
+                index = *done;
+            } else {
+                rebuild(index);
+                done = &index;
+            }
+        });
+    }
+
+    void compactIndex(double threshold) {
+        double t = now();
+        rebuildIndex([&](AutocompleteIndex& index) { index.compact(t, threshold); });
+    }
+
+    void batchLoop() {
+        unique_lock<mutex> lock(queueLock);
+        while (true) {
+            auto ready = [&] { return stopping || !pending.empty(); };
+            if (compactEvery.count() > 0) queueCv.wait_until(lock, nextCompaction, ready);
+            else queueCv.wait(lock, ready);
+
+            if (!pending.empty()) {
+                // everything queued while the last batch was applied goes in together
+                vector<string> batch;
+                batch.swap(pending);
+                lock.unlock();
+
+                unordered_map<string, int> counts;
+                for (auto& s : batch) counts[s]++;
+                double t = now();
+                write([&](AutocompleteIndex& index) {
+                    for (auto& [s, c] : counts) apply(index, s, c, t);
+                });
+
+                lock.lock();
+                applied += batch.size();
+                queueCv.notify_all();
+            } else if (stopping) {
+                return;
+            }
+
+            if (compactEvery.count() > 0 && chrono::steady_clock::now() >= nextCompaction) {
+                double threshold = pruneBelow;
+                lock.unlock();
+                compactIndex(threshold);
+                lock.lock();
+                nextCompaction = chrono::steady_clock::now() + compactEvery;
+            }
+        }
+    }
+
+public:
+    SearchAutocomplete(vector<string>& phrases, vector<int>& counts) {
+        for (int i = 0; i < phrases.size(); i++) {
+            replicas[0].insert(phrases[i], counts[i]);
+        }
+        replicas[0].shrink();
+        replicas[1] = replicas[0];
+        legacy.generation = replicas[0].generation;
+
+        batcher = thread([this] { batchLoop(); });
+    }
+
+    // Serve a prebuilt image (see buildImage); only live inserts use memory
+    explicit SearchAutocomplete(const string& imagePath) {
+        image = make_unique<MappedAutocompleteIndex>(imagePath);
+        // live inserts must reach the same suffix paths as the image's, or
+        // the merge would hide a touched sentence from them
+        if (image->infix()) {
+            for (auto& r : replicas) r.setInfix(true, 0);
+        }
+        batcher = thread([this] { batchLoop(); });
+    }
+
+    // Offline builder: index phrases and write the image
+    static void buildImage(vector<string>& phrases, vector<int>& counts, const string& imagePath,
+                           bool infix = false) {
+        AutocompleteIndex index;
+        index.setInfix(infix, 0);
+        for (size_t i = 0; i < phrases.size(); i++) {
+            index.insert(phrases[i], counts[i]);
+        }
+        index.saveImage(imagePath);
+    }
+
+    ~SearchAutocomplete() {
+        {
+            lock_guard<mutex> lock(queueLock);
+            stopping = true;
+        }
+        queueCv.notify_all();
+        batcher.join();         // drains what is still queued
+    }
+
+    // Insert sentence synchronously; with an image, count must be >= 0
+    void insert(const string& sentence, int count) {
+        if (image && count < 0) throw invalid_argument("negative count with a mapped image");
+        double t = now();
+        write([&](AutocompleteIndex& index) { apply(index, sentence, count, t); });
+    }
+
+    // Age scores with the given half-life. Every compactEverySeconds the
+    // background thread drops sentences whose decayed score fell below
+    // pruneBelowScore and rebuilds all top lists.
+    void enableDecay(double halfLifeSeconds, double pruneBelowScore, double compactEverySeconds) {
+        if (image) throw logic_error("decay is not supported with a mapped image");
+        double t = now();
+        write([&](AutocompleteIndex& index) { index.setHalfLife(halfLifeSeconds, t); });
+        {
+            lock_guard<mutex> lock(queueLock);
+            pruneBelow = pruneBelowScore;
+            compactEvery = chrono::duration_cast<chrono::steady_clock::duration>(
+                chrono::duration<double>(compactEverySeconds));
+            nextCompaction = chrono::steady_clock::now() + compactEvery;
+        }
+        queueCv.notify_all();
+    }
+
+    // Suggest completions of prefixes within maxEdits (0-2) typos of the
+    // input, closest first; 0 restores exact prefix matching
+    void setFuzzy(int maxEdits) {
+        fuzzyEdits = clamp(maxEdits, 0, 2);
+    }
+
+    // Also suggest a sentence when the input matches from one of its later
+    // word starts ("york" -> "new york"); rebuilds the in-memory index. An
+    // image is built with or without infix (see buildImage) and the engine
+    // follows it; asking for infix on an image built without it throws.
+    void enableInfix() {
+        if (image) {
+            if (!image->infix()) throw logic_error("image was built without infix");
+            return;
+        }
+        double t = now();
+        rebuildIndex([&](AutocompleteIndex& index) { index.setInfix(true, t); });
+    }
+
+    // Prune (only below a threshold set by enableDecay) and re-rank now
+    // instead of waiting for the schedule
+    void compact() {
+        double threshold;
+        {
+            lock_guard<mutex> lock(queueLock);
+            threshold = pruneBelow;
+        }
+        compactIndex(threshold);
+    }
+
+    Session openSession() const {
+        Session s;
+        s.generation = read([](const AutocompleteIndex& index) { return index.generation; });
+        return s;
+    }
+
+    // Thread-safe for distinct sessions. '#' queues the sentence and returns
+    // at once; it becomes visible once the batcher has applied it.
+    vector<string> getSuggestions(Session& session, char ch) {
         if (ch == '#') {
-            insert(currentInput, 1);
-            currentInput = "";
+            {
+                lock_guard<mutex> lock(queueLock);
+                pending.push_back(std::move(session.input));
+                enqueued++;
+            }
+            queueCv.notify_all();
+            session.input.clear();
+            session.edits = AutocompleteIndex::NONE;    // rebuild state on the next key
             return {};
         }
 
-        currentInput.push_back(ch);
+        session.input.push_back(ch);
+        uint32_t maxEdits = fuzzyEdits.load();
+        if (maxEdits > 0) return fuzzySuggestions(session, ch, maxEdits);
 
-        TrieNode* node = root;
-        for (char c : currentInput) {
-            if (!node->children.count(c))
-                return {};  // No matches
-            node = node->children[c];
+        bool restart = session.edits != 0;
+        session.edits = 0;
+        if (image) {
+            if (restart) image->walk(session.input, session.imageNode, session.imageDepth);
+            else if (session.imageNode != AutocompleteIndex::NONE) image->step(session.imageNode, session.imageDepth, ch);
         }
 
-        return top3(node->freqMap);
+        return read([&](const AutocompleteIndex& index) {
+            if (restart || session.generation != index.generation) {
+                session.generation = index.generation;
+                index.walk(session.input, session.node, session.depth);
+            } else if (session.node != AutocompleteIndex::NONE) {
+                index.step(session.node, session.depth, ch);
+            }
+
+            if (image) return merged(index, session);
+            if (session.node == AutocompleteIndex::NONE)
+                return vector<string>{};  // No matches
+            return index.top3(session.node);
+        });
+    }
+
+    // Block until every commit queued before this call is in the index
+    void flush() {
+        unique_lock<mutex> lock(queueLock);
+        uint64_t target = enqueued;
+        queueCv.wait(lock, [&] { return applied >= target; });
+    }
+
+    // Single-user API: '#' is applied before returning
+    vector<string> getSuggestions(char ch) {
+        if (ch == '#') {
+            insert(legacy.input, 1);
+            legacy.input.clear();
+            legacy.edits = AutocompleteIndex::NONE;
+            return {};
+        }
+        return getSuggestions(legacy, ch);
+    }
+
+    // Both replicas included
+    double bytesPerSentence() const {
+        return 2 * read([](const AutocompleteIndex& index) { return index.bytesPerSentence(); });
     }
 };
@@ -20,25 +20,301 @@ struct Container {
     State state = State::RUNNING;   // assigned containers begin as RUNNING
 };
 
+// ---------------- CapacityIndex ----------------
+// Machines ordered by (primary free capacity desc, machineId asc), as a treap
+// whose nodes also carry the max secondary free capacity of their subtree.
+// best(minPrimary, minSecondary) returns the first machine in that order that
+// fits both dimensions, i.e. max free primary with the lexicographic tie-break,
+// in O(log n) expected.
+class CapacityIndex {
+private:
+    struct Node {
+        int primary = 0;
+        int secondary = 0;
+        int maxSecondary = 0;
+        uint32_t rank = 0;          // position of machineId in sorted id order
+        uint32_t priority = 0;
+        int left = -1;
+        int right = -1;
+    };
+
+    vector<Node> nodes;             // one node per machine slot
+    int root = -1;
+    mt19937 rng{12345};
+
+    bool before(int a, int b) const {
+        if (nodes[a].primary != nodes[b].primary) return nodes[a].primary > nodes[b].primary;
+        return nodes[a].rank < nodes[b].rank;
+    }
+
+    void pull(int t) {
+        Node &n = nodes[t];
+        n.maxSecondary = n.secondary;
+        if (n.left != -1) n.maxSecondary = max(n.maxSecondary, nodes[n.left].maxSecondary);
+        if (n.right != -1) n.maxSecondary = max(n.maxSecondary, nodes[n.right].maxSecondary);
+    }
+
+    // split t into nodes ordered before x and the rest
+    void split(int t, int x, int &l, int &r) {
+        if (t == -1) { l = r = -1; return; }
+        if (before(t, x)) {
+            split(nodes[t].right, x, nodes[t].right, r);
+            l = t;
+        } else {
+            split(nodes[t].left, x, l, nodes[t].left);
+            r = t;
+        }
+        pull(t);
+    }
+
+    int merge(int l, int r) {
+        if (l == -1) return r;
+        if (r == -1) return l;
+        if (nodes[l].priority > nodes[r].priority) {
+            nodes[l].right = merge(nodes[l].right, r);
+            pull(l);
+            return l;
+        }
+        nodes[r].left = merge(l, nodes[r].left);
+        pull(r);
+        return r;
+    }
+
+    int insertAt(int t, int x) {
+        if (t == -1) return x;
+        if (nodes[x].priority > nodes[t].priority) {
+            split(t, x, nodes[x].left, nodes[x].right);
+            pull(x);
+            return x;
+        }
+        if (before(x, t)) nodes[t].left = insertAt(nodes[t].left, x);
+        else nodes[t].right = insertAt(nodes[t].right, x);
+        pull(t);
+        return t;
+    }
+
+    int eraseAt(int t, int x) {
+        if (t == x) return merge(nodes[t].left, nodes[t].right);
+        if (before(x, t)) nodes[t].left = eraseAt(nodes[t].left, x);
+        else nodes[t].right = eraseAt(nodes[t].right, x);
+        pull(t);
+        return t;
+    }
+
+    int find(int t, int minPrimary, int minSecondary) const {
+        if (t == -1 || nodes[t].maxSecondary < minSecondary) return -1;
+        int hit = find(nodes[t].left, minPrimary, minSecondary);
+        if (hit != -1) return hit;
+        if (nodes[t].primary < minPrimary) return -1;   // t and everything after it too small
+        if (nodes[t].secondary >= minSecondary) return t;
+        return find(nodes[t].right, minPrimary, minSecondary);
+    }
+
+    int findLast(int t, int minPrimary, int minSecondary) const {
+        if (t == -1 || nodes[t].maxSecondary < minSecondary) return -1;
+        if (nodes[t].primary < minPrimary)              // t and everything after it too small
+            return findLast(nodes[t].left, minPrimary, minSecondary);
+        int hit = findLast(nodes[t].right, minPrimary, minSecondary);
+        if (hit != -1) return hit;
+        if (nodes[t].secondary >= minSecondary) return t;
+        return findLast(nodes[t].left, minPrimary, minSecondary);
+    }
+
+public:
+    void insert(int slot, uint32_t rank, int primary, int secondary) {
+        if (slot >= (int)nodes.size()) nodes.resize(slot + 1);
+        nodes[slot] = Node{primary, secondary, secondary, rank, (uint32_t)rng(), -1, -1};
+        root = insertAt(root, slot);
+    }
+
+    void erase(int slot) {
+        root = eraseAt(root, slot);
+    }
+
+    uint32_t rankOf(int slot) const {
+        return nodes[slot].rank;
+    }
+
+    void update(int slot, int primary, int secondary) {
+        erase(slot);
+        insert(slot, nodes[slot].rank, primary, secondary);
+    }
+
+    // machine slot with max free primary among those with at least
+    // minPrimary / minSecondary free, ties by machineId; -1 if none fits
+    int best(int minPrimary, int minSecondary) const {
+        return find(root, minPrimary, minSecondary);
+    }
+
+    // machine slot with the least free primary that still fits (best fit),
+    // ties to the larger machineId; -1 if none fits
+    int tightest(int minPrimary, int minSecondary) const {
+        return findLast(root, minPrimary, minSecondary);
+    }
+};
+
+struct PlacementRequest {
+    string name;
+    string image;
+    int cpu;
+    int mem;
+};
+
+struct PlacementReport {
+    int placed = 0;                 // requests.size() on success, 0 otherwise
+    vector<string> machineIds;      // per request, in request order
+    int machinesUsed = 0;           // machines with any usage after the batch
+    double cpuUtilization = 0;      // used / total over those machines
+    double memUtilization = 0;
+};
+
+// "machineId,totalCpuUnits,totalMemoryMB" rows; a repeated id replaces the earlier row
+vector<Machine> parseMachines(const vector<string>& machineRows) {
+    vector<Machine> machines;
+    unordered_map<string, size_t> seen;
+
+    for (auto &row : machineRows) {
+        stringstream ss(row);
+        string id, cpuStr, memStr;
+
+        getline(ss, id, ',');
+        getline(ss, cpuStr, ',');
+        getline(ss, memStr, ',');
+
+        Machine m{id, stoi(cpuStr), stoi(memStr), 0, 0};
+        auto it = seen.find(id);
+        if (it != seen.end()) {
+            machines[it->second] = m;
+        } else {
+            seen[id] = machines.size();
+            machines.push_back(m);
+        }
+    }
+    return machines;
+}
+
+// machine indexes in machineId order
+vector<int> idOrder(const vector<Machine>& machines) {
+    vector<int> order(machines.size());
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(),
+         [&](int a, int b) { return machines[a].id < machines[b].id; });
+    return order;
+}
+
+// Generation-checked reference to a container table slot; goes stale on remove
+struct ContainerHandle {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
 class ContainerManager {
 private:
-    unordered_map<string, Machine> machines;            // machineId -> Machine
-    unordered_map<string, Container> containers;        // containerName -> Container
+    // Container table slot; freed slots are reused with a bumped generation
+    struct ContainerSlot {
+        Container c;
+        uint32_t generation = 0;
+        uint32_t hostPos = 0;           // position in hosted[machine] while RUNNING
+        bool live = false;
+    };
+
+    vector<Machine> machines;                           // slot -> Machine
+    unordered_map<string, int> machineSlots;            // machineId -> slot (live machines)
+    vector<char> cordoned;                              // slot -> out of the indexes
+    vector<vector<uint32_t>> hosted;                    // slot -> RUNNING container slots
+    vector<ContainerSlot> table;                        // container slot-map
+    vector<uint32_t> freeSlots;
+    unordered_map<string, uint32_t> containerSlots;     // containerName -> table index
+    CapacityIndex byFreeCpu;                            // criteria 0
+    CapacityIndex byFreeMem;                            // criteria 1
+
+    // fleet totals, and capacity of machines currently hosting anything
+    long long fleetCpu = 0, fleetMem = 0, fleetUsedCpu = 0, fleetUsedMem = 0;
+    long long activeCpu = 0, activeMem = 0;
+    int activeMachines = 0;
+
+    // apply a usage change to machine slot and keep indexes and totals in step
+    void reserve(int slot, int cpu, int mem) {
+        Machine &m = machines[slot];
+        bool wasActive = m.usedCpu || m.usedMem;
+        m.usedCpu += cpu;
+        m.usedMem += mem;
+        fleetUsedCpu += cpu;
+        fleetUsedMem += mem;
+        bool active = m.usedCpu || m.usedMem;
+        if (active != wasActive) {
+            int sign = active ? 1 : -1;
+            activeMachines += sign;
+            activeCpu += sign * (long long)m.totalCpu;
+            activeMem += sign * (long long)m.totalMem;
+        }
+        if (cordoned[slot]) return;
+        int freeCpu = m.totalCpu - m.usedCpu;
+        int freeMem = m.totalMem - m.usedMem;
+        byFreeCpu.update(slot, freeCpu, freeMem);
+        byFreeMem.update(slot, freeMem, freeCpu);
+    }
+
+    // max free CPU (criteria 0) or max free MEM, ties → smaller machineId
+    int pick(int criteria, int cpu, int mem) const {
+        return criteria == 0 ? byFreeCpu.best(cpu, mem) : byFreeMem.best(mem, cpu);
+    }
+
+    uint32_t addContainer(Container c) {
+        uint32_t idx;
+        if (!freeSlots.empty()) {
+            idx = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            idx = table.size();
+            table.emplace_back();
+        }
+        containerSlots[c.name] = idx;
+        table[idx].c = move(c);
+        table[idx].live = true;
+        return idx;
+    }
+
+    // charge a container to a machine and list it there
+    void host(uint32_t idx, int slot) {
+        ContainerSlot &cs = table[idx];
+        reserve(slot, cs.c.cpu, cs.c.mem);
+        cs.c.machineId = machines[slot].id;
+        cs.c.state = State::RUNNING;
+        cs.hostPos = hosted[slot].size();
+        hosted[slot].push_back(idx);
+    }
+
+    void unhost(uint32_t idx) {
+        ContainerSlot &cs = table[idx];
+        int slot = machineSlots.at(cs.c.machineId);
+        reserve(slot, -cs.c.cpu, -cs.c.mem);
+
+        vector<uint32_t> &list = hosted[slot];
+        uint32_t last = list.back();
+        list[cs.hostPos] = last;
+        table[last].hostPos = cs.hostPos;
+        list.pop_back();
+        cs.c.state = State::STOPPED;
+    }
 
 public:
 
     // 1) Constructor
     ContainerManager(const vector<string>& machineRows) {
-        for (auto &row : machineRows) {
-            // format: "machineId,totalCpuUnits,totalMemoryMB"
-            stringstream ss(row);
-            string id, cpuStr, memStr;
+        machines = parseMachines(machineRows);
+        for (size_t i = 0; i < machines.size(); i++) machineSlots[machines[i].id] = i;
+        cordoned.assign(machines.size(), 0);
+        hosted.resize(machines.size());
 
-            getline(ss, id, ',');
-            getline(ss, cpuStr, ',');
-            getline(ss, memStr, ',');
-
-            machines[id] = Machine{id, stoi(cpuStr), stoi(memStr), 0, 0};
+        vector<int> order = idOrder(machines);
+        for (uint32_t rank = 0; rank < order.size(); rank++) {
+            int slot = order[rank];
+            const Machine &m = machines[slot];
+            fleetCpu += m.totalCpu;
+            fleetMem += m.totalMem;
+            byFreeCpu.insert(slot, rank, m.totalCpu, m.totalMem);
+            byFreeMem.insert(slot, rank, m.totalMem, m.totalCpu);
         }
     }
 
@@ -47,59 +323,379 @@ public:
                          int cpuUnits, int memMb)
     {
         if (containerName.empty() || cpuUnits <= 0 || memMb <= 0) return "";
-        if (containers.count(containerName)) return "";   // name must be unique
+        if (containerSlots.count(containerName)) return "";   // name must be unique
+
+        int slot = pick(criteria, cpuUnits, memMb);
+        if (slot == -1) return "";
+
+        // Assign container to chosen machine
+        uint32_t idx = addContainer(Container{containerName, imageUrl, cpuUnits, memMb, "", State::RUNNING});
+        host(idx, slot);
+        return machines[slot].id;
+    }
 
-        string bestId = "";
-        int bestScore = -1;   // we choose MAX score (CPU or MEM)
+    // 3) assignMany() - gang placement, all or nothing
+    // Best-fit decreasing on the batch's dominant resource: requests are
+    // placed largest first (by share of that resource), each on the machine
+    // with the least free amount of it that still fits both dimensions.
+    PlacementReport assignMany(const vector<PlacementRequest>& requests) {
+        PlacementReport report;
 
-        for (auto &p : machines) {
-            auto &m = p.second;
+        long long freeCpu = fleetCpu - fleetUsedCpu, freeMem = fleetMem - fleetUsedMem;
+        long long needCpu = 0, needMem = 0;
 
-            int freeCpu = m.totalCpu - m.usedCpu;
-            int freeMem = m.totalMem - m.usedMem;
+        unordered_set<string> seen;
+        seen.reserve(requests.size());
+        for (auto &r : requests) {
+            if (r.name.empty() || r.cpu <= 0 || r.mem <= 0) return report;
+            if (containerSlots.count(r.name) || !seen.insert(r.name).second) return report;
+            needCpu += r.cpu;
+            needMem += r.mem;
+        }
+        if (needCpu > freeCpu || needMem > freeMem) return report;
 
-            if (freeCpu < cpuUnits || freeMem < memMb)
-                continue;  // cannot fit
+        // pack along whichever resource the batch consumes the larger share of
+        bool byCpu = (double)needCpu * max(freeMem, 1LL) >= (double)needMem * max(freeCpu, 1LL);
+        CapacityIndex &index = byCpu ? byFreeCpu : byFreeMem;
 
-            int score = (criteria == 0 ? freeCpu : freeMem);
+        vector<int> order(requests.size());
+        iota(order.begin(), order.end(), 0);
+        stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return byCpu ? requests[a].cpu > requests[b].cpu
+                         : requests[a].mem > requests[b].mem;
+        });
 
-            if (score > bestScore) {
-                bestScore = score;
-                bestId = m.id;
-            } else if (score == bestScore && score != -1) {
-                // tie → lexicographically smaller machineId
-                if (m.id < bestId) bestId = m.id;
+        vector<int> slots(requests.size(), -1);
+        for (int i : order) {
+            const PlacementRequest &r = requests[i];
+            int slot = byCpu ? index.tightest(r.cpu, r.mem) : index.tightest(r.mem, r.cpu);
+            if (slot == -1) {
+                // roll back everything reserved so far
+                for (int j : order) {
+                    if (slots[j] == -1) continue;
+                    reserve(slots[j], -requests[j].cpu, -requests[j].mem);
+                }
+                return report;
             }
+            reserve(slot, r.cpu, r.mem);
+            slots[i] = slot;
         }
 
-        if (bestId == "") return "";
+        containerSlots.reserve(containerSlots.size() + requests.size());
+        report.machineIds.reserve(requests.size());
+        for (size_t i = 0; i < requests.size(); i++) {
+            const PlacementRequest &r = requests[i];
+            int slot = slots[i];
+            uint32_t idx = addContainer(Container{r.name, r.image, r.cpu, r.mem, machines[slot].id, State::RUNNING});
+            table[idx].hostPos = hosted[slot].size();
+            hosted[slot].push_back(idx);
+            report.machineIds.push_back(machines[slot].id);
+        }
+        report.placed = requests.size();
 
-        // Assign container to chosen machine
-        machines[bestId].usedCpu += cpuUnits;
-        machines[bestId].usedMem += memMb;
+        report.machinesUsed = activeMachines;
+        if (activeCpu) report.cpuUtilization = (double)fleetUsedCpu / activeCpu;
+        if (activeMem) report.memUtilization = (double)fleetUsedMem / activeMem;
+        return report;
+    }
+
+    // 4) stop()
+    bool stop(const string &name) {
+        auto it = containerSlots.find(name);
+        if (it == containerSlots.end()) return false;
+        if (table[it->second].c.state == State::STOPPED) return false;
+
+        // free machine resources
+        unhost(it->second);
+        return true;
+    }
+
+    // 5) restart() - back on the previous machine if it still fits, else by criteria
+    string restart(const string &name, int criteria = 0) {
+        auto it = containerSlots.find(name);
+        if (it == containerSlots.end()) return "";
+        uint32_t idx = it->second;
+        Container &c = table[idx].c;
+        if (c.state == State::RUNNING) return "";
+
+        int slot = -1;
+        auto prev = machineSlots.find(c.machineId);
+        if (prev != machineSlots.end() && !cordoned[prev->second]) {
+            const Machine &m = machines[prev->second];
+            if (m.totalCpu - m.usedCpu >= c.cpu && m.totalMem - m.usedMem >= c.mem)
+                slot = prev->second;
+        }
+        if (slot == -1) slot = pick(criteria, c.cpu, c.mem);
+        if (slot == -1) return "";
+
+        host(idx, slot);
+        return machines[slot].id;
+    }
+
+    // 6) remove() - stops if needed and frees the name and table slot
+    bool remove(const string &name) {
+        auto it = containerSlots.find(name);
+        if (it == containerSlots.end()) return false;
+        uint32_t idx = it->second;
+
+        if (table[idx].c.state == State::RUNNING) unhost(idx);
+        containerSlots.erase(it);
+
+        ContainerSlot &cs = table[idx];
+        cs.c = Container{};
+        cs.live = false;
+        cs.generation++;
+        freeSlots.push_back(idx);
+        return true;
+    }
+
+    // 7) drain() - cordon the machine and move its running containers
+    // elsewhere, largest first; returns how many are still on it
+    int drain(const string &machineId, int criteria = 0) {
+        auto it = machineSlots.find(machineId);
+        if (it == machineSlots.end()) return -1;
+        int from = it->second;
+
+        if (!cordoned[from]) {
+            byFreeCpu.erase(from);
+            byFreeMem.erase(from);
+            cordoned[from] = 1;
+        }
+
+        vector<uint32_t> moving = hosted[from];
+        sort(moving.begin(), moving.end(), [&](uint32_t a, uint32_t b) {
+            const Container &x = table[a].c, &y = table[b].c;
+            return x.cpu != y.cpu ? x.cpu > y.cpu : x.mem > y.mem;
+        });
+
+        for (uint32_t idx : moving) {
+            const Container &c = table[idx].c;
+            int to = pick(criteria, c.cpu, c.mem);
+            if (to == -1) continue;
+            unhost(idx);
+            host(idx, to);
+        }
+        return hosted[from].size();
+    }
+
+    // 8) uncordon() - let a drained machine take placements again
+    bool uncordon(const string &machineId) {
+        auto it = machineSlots.find(machineId);
+        if (it == machineSlots.end() || !cordoned[it->second]) return false;
+        int slot = it->second;
+        const Machine &m = machines[slot];
+
+        cordoned[slot] = 0;
+        byFreeCpu.insert(slot, byFreeCpu.rankOf(slot), m.totalCpu - m.usedCpu, m.totalMem - m.usedMem);
+        byFreeMem.insert(slot, byFreeMem.rankOf(slot), m.totalMem - m.usedMem, m.totalCpu - m.usedCpu);
+        return true;
+    }
+
+    // 9) decommission() - drain, then retire the machine once it is empty
+    bool decommission(const string &machineId, int criteria = 0) {
+        if (drain(machineId, criteria) != 0) return false;
+
+        int slot = machineSlots[machineId];
+        fleetCpu -= machines[slot].totalCpu;
+        fleetMem -= machines[slot].totalMem;
+        machineSlots.erase(machineId);
+        hosted[slot].shrink_to_fit();
+        return true;
+    }
+
+    // 10) Handles: O(1) generation-checked access to the container table
+    ContainerHandle handleOf(const string &name) const {
+        auto it = containerSlots.find(name);
+        if (it == containerSlots.end()) return ContainerHandle{};
+        return ContainerHandle{it->second, table[it->second].generation};
+    }
+
+    const Container* get(ContainerHandle h) const {
+        if (h.index >= table.size()) return nullptr;
+        const ContainerSlot &cs = table[h.index];
+        if (!cs.live || cs.generation != h.generation) return nullptr;
+        return &cs.c;
+    }
+};
+
+
+// ---------------- ConcurrentContainerManager ----------------
+// Thread-safe ContainerManager. Machines are dealt round-robin (in id order)
+// over shards; each shard owns its machines and capacity indexes under its
+// own lock and bumps a version on every change. assignMachine scores all
+// shards under shared locks, then commits on the winning shard only if its
+// version (or, failing that, its best machine) is unchanged, else retries.
+class ConcurrentContainerManager {
+private:
+    struct alignas(64) Shard {
+        shared_mutex lock;
+        uint64_t version = 0;
+        vector<Machine> machines;
+        vector<uint32_t> ranks;         // global machineId rank per slot
+        CapacityIndex byFreeCpu;
+        CapacityIndex byFreeMem;
+    };
+
+    struct alignas(64) Registry {
+        mutex lock;
+        unordered_map<string, Container> containers;
+    };
 
-        containers[containerName] =
-            Container{containerName, imageUrl, cpuUnits, memMb, bestId, State::RUNNING};
+    struct Candidate {
+        int shard = -1;
+        int slot = -1;
+        int score = -1;
+        uint32_t rank = 0;
+        uint64_t version = 0;
+    };
+
+    static constexpr int REGISTRY_STRIPES = 16;
+
+    vector<unique_ptr<Shard>> shards;
+    Registry registries[REGISTRY_STRIPES];
+    unordered_map<string, pair<int, int>> machineSlots;    // machineId -> (shard, slot), fixed
+    atomic<uint64_t> retries{0};
 
-        return bestId;
+    Registry& registryFor(const string& name) {
+        return registries[hash<string>{}(name) % REGISTRY_STRIPES];
+    }
+
+    // caller holds the shard lock exclusively
+    static void reserve(Shard& sh, int slot, int cpu, int mem) {
+        Machine &m = sh.machines[slot];
+        m.usedCpu += cpu;
+        m.usedMem += mem;
+        int freeCpu = m.totalCpu - m.usedCpu;
+        int freeMem = m.totalMem - m.usedMem;
+        sh.byFreeCpu.update(slot, freeCpu, freeMem);
+        sh.byFreeMem.update(slot, freeMem, freeCpu);
+        sh.version++;
+    }
+
+    // caller holds the shard lock (shared is enough)
+    static Candidate score(const Shard& sh, int criteria, int cpu, int mem) {
+        Candidate c;
+        c.slot = (criteria == 0 ? sh.byFreeCpu.best(cpu, mem) : sh.byFreeMem.best(mem, cpu));
+        if (c.slot == -1) return c;
+
+        const Machine &m = sh.machines[c.slot];
+        c.score = (criteria == 0 ? m.totalCpu - m.usedCpu : m.totalMem - m.usedMem);
+        c.rank = sh.ranks[c.slot];
+        c.version = sh.version;
+        return c;
+    }
+
+public:
+
+    // 1) Constructor
+    explicit ConcurrentContainerManager(const vector<string>& machineRows, int shardCount = 8) {
+        for (int i = 0; i < max(shardCount, 1); i++) shards.push_back(make_unique<Shard>());
+
+        vector<Machine> all = parseMachines(machineRows);
+        vector<int> order = idOrder(all);
+
+        for (uint32_t rank = 0; rank < order.size(); rank++) {
+            const Machine &m = all[order[rank]];
+            int s = rank % shards.size();
+            Shard &sh = *shards[s];
+            int slot = sh.machines.size();
+
+            sh.machines.push_back(m);
+            sh.ranks.push_back(rank);
+            sh.byFreeCpu.insert(slot, rank, m.totalCpu, m.totalMem);
+            sh.byFreeMem.insert(slot, rank, m.totalMem, m.totalCpu);
+            machineSlots[m.id] = {s, slot};
+        }
+    }
+
+    // 2) assignMachine() - same criteria and tie-break as ContainerManager
+    string assignMachine(int criteria, const string& containerName, const string& imageUrl,
+                         int cpuUnits, int memMb)
+    {
+        if (containerName.empty() || cpuUnits <= 0 || memMb <= 0) return "";
+
+        Registry &reg = registryFor(containerName);
+        {
+            lock_guard<mutex> g(reg.lock);
+            if (reg.containers.count(containerName)) return "";
+        }
+
+        Candidate best;
+        while (true) {
+            best = Candidate{};
+            for (int s = 0; s < (int)shards.size(); s++) {
+                shared_lock<shared_mutex> g(shards[s]->lock);
+                Candidate c = score(*shards[s], criteria, cpuUnits, memMb);
+                if (c.slot == -1) continue;
+                if (best.shard == -1 || c.score > best.score ||
+                    (c.score == best.score && c.rank < best.rank)) {
+                    best = c;
+                    best.shard = s;
+                }
+            }
+            if (best.shard == -1) return "";
+
+            // commit only if the winner is still what we scored
+            Shard &sh = *shards[best.shard];
+            unique_lock<shared_mutex> g(sh.lock);
+            if (sh.version != best.version) {
+                Candidate now = score(sh, criteria, cpuUnits, memMb);
+                if (now.slot != best.slot || now.score != best.score) {
+                    retries.fetch_add(1, memory_order_relaxed);
+                    continue;
+                }
+            }
+            reserve(sh, best.slot, cpuUnits, memMb);
+            break;
+        }
+
+        Shard &sh = *shards[best.shard];
+        const string &machineId = sh.machines[best.slot].id;    // ids never change
+
+        {
+            lock_guard<mutex> g(reg.lock);
+            if (!reg.containers.count(containerName)) {
+                reg.containers[containerName] =
+                    Container{containerName, imageUrl, cpuUnits, memMb, machineId, State::RUNNING};
+                return machineId;
+            }
+        }
+
+        // lost the name to a concurrent assign; give the capacity back
+        unique_lock<shared_mutex> g(sh.lock);
+        reserve(sh, best.slot, -cpuUnits, -memMb);
+        return "";
     }
 
     // 3) stop()
-    bool stop(const string &name) {
-        auto it = containers.find(name);
-        if (it == containers.end()) return false;
+    bool stop(const string& name) {
+        Registry &reg = registryFor(name);
+        pair<int, int> where;
+        int cpu, mem;
+        {
+            lock_guard<mutex> g(reg.lock);
+            auto it = reg.containers.find(name);
+            if (it == reg.containers.end()) return false;
 
-        Container &c = it->second;
-        if (c.state == State::STOPPED) return false;
+            Container &c = it->second;
+            if (c.state == State::STOPPED) return false;
 
-        // free machine resources
-        Machine &m = machines[c.machineId];
-        m.usedCpu -= c.cpu;
-        m.usedMem -= c.mem;
+            c.state = State::STOPPED;
+            where = machineSlots.at(c.machineId);
+            cpu = c.cpu;
+            mem = c.mem;
+        }
 
-        c.state = State::STOPPED;
+        Shard &sh = *shards[where.first];
+        unique_lock<shared_mutex> g(sh.lock);
+        reserve(sh, where.second, -cpu, -mem);
         return true;
     }
+
+    // 4) Commits that had to rescore because another placement won the race
+    uint64_t retryCount() const {
+        return retries.load(memory_order_relaxed);
+    }
 };
 
 
@@ -119,4 +715,18 @@ int main() {
 
     cout << mgr.stop("c1") << "\n";  // 1 (success)
     cout << mgr.stop("c1") << "\n";  // 0 (already stopped)
+
+    PlacementReport batch = mgr.assignMany({
+        {"web-1", "nginx", 2, 1000},
+        {"web-2", "nginx", 2, 1000},
+        {"db-1", "postgres", 4, 8000}
+    });
+    cout << batch.placed << " placed on " << batch.machinesUsed << " machines\n";
+
+    cout << mgr.restart("c1") << "\n";           // a3 (previous machine)
+    cout << mgr.drain("m2") << "\n";             // 0 (everything moved off m2)
+    cout << mgr.decommission("m2") << "\n";      // 1
+    ContainerHandle h = mgr.handleOf("c2");
+    cout << mgr.remove("c2") << "\n";            // 1
+    cout << (mgr.get(h) == nullptr) << "\n";     // 1 (handle is stale)
 }
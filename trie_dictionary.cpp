@@ -1,100 +1,655 @@
 #include <bits/stdc++.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 using namespace std;
 
-class Dictionary {
+// ---------------- On-disk dictionary image ----------------
+// Position-independent: every reference is an offset or an index, so the
+// file can be mapped anywhere and shared read-only between processes.
+struct ImageHeader {
+    char magic[8];              // "DICTIMG1"
+    uint32_t nodeCount;
+    uint32_t childCount;
+    uint64_t nodesOff;          // ImageNode[nodeCount]
+    uint64_t childrenOff;       // uint32_t[childCount] node ids
+    uint64_t firstBytesOff;     // uint8_t[childCount] first label byte per child
+    uint64_t poolOff;           // labels and meanings
+    uint64_t poolLen;
+};
+
+struct ImageNode {
+    uint64_t labelOff;          // into the pool
+    uint64_t meaningOff;
+    uint32_t labelLen;
+    uint32_t meaningLen;
+    uint32_t childBegin;        // children of a node are contiguous, sorted
+    uint32_t childCount;
+    uint32_t isEnd;
+    uint32_t pad;
+};
+
+// Child table keyed by the next byte, adapting to fan-out: a sorted
+// (key, id) array for sparse nodes, a 256-bit bitmap plus ids packed in key
+// order (rank by popcount) for medium ones, and a direct 256-slot table for
+// dense ones. All three live in a single vector, so sparse nodes stay small.
+class ChildMap {
+public:
+    int find(uint8_t key) const {
+        switch (kind) {
+        case SMALL:
+            for (uint16_t i = 0; i < count; i++) {
+                if (slots[2 * i] == key) return slots[2 * i + 1];
+                if (slots[2 * i] > key) break;
+            }
+            return -1;
+        case BITMAP:
+            return hasBit(key) ? (int)slots[BITMAP_WORDS + rank(key)] : -1;
+        default:
+            return (int)slots[key];
+        }
+    }
+
+    // First child with key >= `key` (0..256); updates key, -1 when none left
+    int next(int& key) const {
+        switch (kind) {
+        case SMALL:
+            for (uint16_t i = 0; i < count; i++)
+                if ((int)slots[2 * i] >= key) { key = slots[2 * i]; return slots[2 * i + 1]; }
+            return -1;
+        case BITMAP:
+            for (int w = key >> 5; w < BITMAP_WORDS; w++) {
+                uint32_t bits = slots[w];
+                if (w == key >> 5) bits &= ~0u << (key & 31);
+                if (bits) {
+                    key = (w << 5) + __builtin_ctz(bits);
+                    return slots[BITMAP_WORDS + rank(key)];
+                }
+            }
+            return -1;
+        default:
+            for (; key < 256; key++)
+                if ((int)slots[key] >= 0) return slots[key];
+            return -1;
+        }
+    }
+
+    // Insert or replace
+    void set(uint8_t key, int id) {
+        if (find(key) >= 0) { slot(key) = id; return; }
+        if (kind == SMALL && count == SMALL_MAX) convert(BITMAP);
+        else if (kind == BITMAP && count == BITMAP_MAX) convert(FULL);
+
+        switch (kind) {
+        case SMALL: {
+            uint16_t i = 0;
+            while (i < count && slots[2 * i] < key) i++;
+            slots.insert(slots.begin() + 2 * i, {key, (uint32_t)id});
+            break;
+        }
+        case BITMAP:
+            slots[key >> 5] |= 1u << (key & 31);
+            slots.insert(slots.begin() + BITMAP_WORDS + rank(key), id);
+            break;
+        default:
+            slots[key] = id;
+        }
+        count++;
+    }
+
+    void erase(uint8_t key) {
+        if (find(key) < 0) return;
+        switch (kind) {
+        case SMALL: {
+            uint16_t i = 0;
+            while (slots[2 * i] != key) i++;
+            slots.erase(slots.begin() + 2 * i, slots.begin() + 2 * i + 2);
+            break;
+        }
+        case BITMAP:
+            slots.erase(slots.begin() + BITMAP_WORDS + rank(key));
+            slots[key >> 5] &= ~(1u << (key & 31));
+            break;
+        default:
+            slots[key] = EMPTY;
+        }
+        count--;
+
+        // demote with some hysteresis so alternating edits don't thrash
+        if (kind == FULL && count < BITMAP_MAX * 3 / 4) convert(BITMAP);
+        else if (kind == BITMAP && count < SMALL_MAX / 2) convert(SMALL);
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    size_t bytes() const { return slots.capacity() * sizeof(uint32_t); }
+    void shrink() { slots.shrink_to_fit(); }
+
+    // Add delta to every child id (when splicing node arrays together)
+    void shiftIds(int delta) {
+        switch (kind) {
+        case SMALL:
+            for (uint16_t i = 0; i < count; i++) slots[2 * i + 1] += delta;
+            break;
+        case BITMAP:
+            for (size_t i = BITMAP_WORDS; i < slots.size(); i++) slots[i] += delta;
+            break;
+        default:
+            for (uint32_t& id : slots) if (id != EMPTY) id += delta;
+        }
+    }
+
 private:
-    static const int ALPHABET = 26;
+    enum Kind : uint8_t { SMALL, BITMAP, FULL };
+    static constexpr uint16_t SMALL_MAX = 8;
+    static constexpr uint16_t BITMAP_MAX = 64;
+    static constexpr int BITMAP_WORDS = 8;
+    static constexpr uint32_t EMPTY = UINT32_MAX;
 
-    struct TrieNode {
-        bool isEnd = false;
-        TrieNode* next[ALPHABET];
+    Kind kind = SMALL;
+    uint16_t count = 0;
+    vector<uint32_t> slots;   // SMALL: key,id pairs; BITMAP: 8 words + ids; FULL: 256 ids
+
+    bool hasBit(uint8_t key) const { return slots[key >> 5] >> (key & 31) & 1; }
+
+    // Number of present keys below key
+    int rank(uint8_t key) const {
+        int r = 0;
+        for (int w = 0; w < (key >> 5); w++) r += __builtin_popcount(slots[w]);
+        uint32_t low = (key & 31) ? slots[key >> 5] & ((1u << (key & 31)) - 1) : 0;
+        return r + __builtin_popcount(low);
+    }
+
+    uint32_t& slot(uint8_t key) {
+        if (kind == SMALL) {
+            uint16_t i = 0;
+            while (slots[2 * i] != key) i++;
+            return slots[2 * i + 1];
+        }
+        return kind == BITMAP ? slots[BITMAP_WORDS + rank(key)] : slots[key];
+    }
 
-        TrieNode() {
-            memset(next, 0, sizeof(next));
+    void convert(Kind to) {
+        vector<pair<uint8_t, uint32_t>> all;
+        for (int key = 0, id; (id = next(key)) >= 0; key++) all.push_back({key, id});
+
+        kind = to;
+        slots.clear();
+        if (to == SMALL) {
+            for (auto& [k, id] : all) { slots.push_back(k); slots.push_back(id); }
+        } else if (to == BITMAP) {
+            slots.assign(BITMAP_WORDS, 0);
+            for (auto& [k, id] : all) { slots[k >> 5] |= 1u << (k & 31); slots.push_back(id); }
+        } else {
+            slots.assign(256, EMPTY);
+            for (auto& [k, id] : all) slots[k] = id;
         }
+        slots.shrink_to_fit();
+    }
+};
+
+class Dictionary {
+private:
+    // Radix (path-compressed) trie. Nodes live in one vector and refer to each
+    // other by index; edge labels are slices of a shared byte pool.
+    struct RadixNode {
+        uint32_t labelOff = 0;    // edge label leading into this node
+        uint32_t labelLen = 0;
+        bool isEnd = false;
+        uint32_t bucketSlot = 0;  // position in byLength[word length] while isEnd
+        int parent = -1;          // -1 for the root and for free slots
+        uint64_t lengthMask = 0;  // bit min(L, 63) set if a word of length L is below
+        ChildMap children;        // keyed by first label byte
+    };
+
+    // Where a prefix walk stopped: `consumed` bytes into node's label
+    struct Cursor {
+        int node;
+        uint32_t consumed;
     };
 
-    TrieNode* root;
+    vector<RadixNode> nodes;      // nodes[0] is the root
+    string labelPool;
     unordered_map<string, string> meanings;
+    vector<vector<int>> byLength; // word length -> terminal nodes
+    vector<int> freeNodes;        // slots released by removeWord, reused first
+    size_t deadLabelBytes = 0;    // pool bytes no live label points at
 
-    inline int toIndex(char c) const {
-        return c - 'a';
+    // Wildcard queries scan a length bucket instead of the trie below this size
+    static const size_t BUCKET_SCAN_LIMIT = 256;
+
+    static inline uint64_t lengthBit(size_t len) {
+        return 1ull << min<size_t>(len, 63);
+    }
+
+    inline unsigned char labelAt(int node, uint32_t i) const {
+        return labelPool[nodes[node].labelOff + i];
     }
 
-    inline char toChar(int i) const {
-        return 'a' + i;
+    int findChild(int node, unsigned char c) const {
+        return nodes[node].children.find(c);
+    }
+
+    int newNode(uint32_t off, uint32_t len) {
+        int id;
+        if (!freeNodes.empty()) {
+            id = freeNodes.back();
+            freeNodes.pop_back();
+        } else {
+            id = nodes.size();
+            nodes.emplace_back();
+        }
+        nodes[id].labelOff = off;
+        nodes[id].labelLen = len;
+        return id;
+    }
+
+    void freeNode(int id) {
+        deadLabelBytes += nodes[id].labelLen;
+        nodes[id] = RadixNode();    // releases the child table
+        freeNodes.push_back(id);
+    }
+
+    void addChild(int parent, int child) {
+        nodes[parent].children.set(labelAt(child, 0), child);
+    }
+
+    // Cut child's label after k bytes; the head becomes a new parent node
+    int splitNode(int parent, int child, uint32_t k) {
+        int mid = newNode(nodes[child].labelOff, k);
+        nodes[child].labelOff += k;
+        nodes[child].labelLen -= k;
+        addChild(mid, child);
+        nodes[mid].parent = parent;
+        nodes[mid].lengthMask = nodes[child].lengthMask;
+        nodes[child].parent = mid;
+
+        addChild(parent, mid);   // same first byte: replaces child
+        return mid;
     }
 
     // Insert a word into the Trie
-    void trieInsert(const string& word) {
-        TrieNode* cur = root;
-        for (char c : word) {
-            int idx = toIndex(c);
-            if (!cur->next[idx])
-                cur->next[idx] = new TrieNode();
-            cur = cur->next[idx];
+    void trieInsert(string_view word) {
+        uint64_t bit = lengthBit(word.size());
+        int cur = 0;
+        size_t i = 0;
+        nodes[0].lengthMask |= bit;
+        while (i < word.size()) {
+            int child = findChild(cur, word[i]);
+            if (child < 0) {
+                child = newNode(labelPool.size(), word.size() - i);
+                labelPool.append(word, i, string::npos);
+                nodes[child].parent = cur;
+                addChild(cur, child);
+                cur = child;
+                nodes[cur].lengthMask |= bit;
+                break;
+            }
+
+            uint32_t k = 0, len = nodes[child].labelLen;
+            while (k < len && i + k < word.size() && labelAt(child, k) == (unsigned char)word[i + k]) k++;
+            if (k < len) child = splitNode(cur, child, k);
+            cur = child;
+            nodes[cur].lengthMask |= bit;
+            i += k;
+        }
+        nodes[cur].isEnd = true;
+
+        if (byLength.size() <= word.size()) byLength.resize(word.size() + 1);
+        nodes[cur].bucketSlot = byLength[word.size()].size();
+        byLength[word.size()].push_back(cur);
+    }
+
+    void unbucket(int node, size_t len) {
+        vector<int>& bucket = byLength[len];
+        uint32_t slot = nodes[node].bucketSlot;
+        bucket[slot] = bucket.back();
+        nodes[bucket[slot]].bucketSlot = slot;
+        bucket.pop_back();
+    }
+
+    // Fold a non-terminal node with a single child into that child, which
+    // keeps its id (and so its length bucket entry)
+    void mergeWithChild(int node) {
+        int key = 0;
+        int child = nodes[node].children.next(key);
+        RadixNode& n = nodes[node];
+        RadixNode& c = nodes[child];
+
+        if (n.labelOff + n.labelLen == c.labelOff) {
+            c.labelOff = n.labelOff;        // halves of an earlier split
+        } else {
+            string label = labelPool.substr(n.labelOff, n.labelLen) +
+                           labelPool.substr(c.labelOff, c.labelLen);
+            deadLabelBytes += label.size();
+            c.labelOff = labelPool.size();
+            labelPool += label;
+        }
+        c.labelLen += n.labelLen;
+        c.parent = n.parent;
+        n.labelLen = 0;                     // its bytes now belong to child
+        addChild(c.parent, child);          // same first byte: replaces node
+        freeNode(node);
+    }
+
+    // Recompute lengthMask from node up to the root; depth is the length of
+    // the string spelled down to the end of node's label
+    void refreshMasks(int node, size_t depth) {
+        while (node >= 0) {
+            RadixNode& n = nodes[node];
+            uint64_t mask = n.isEnd ? lengthBit(depth) : 0;
+            for (int key = 0, child; (child = n.children.next(key)) >= 0; key++)
+                mask |= nodes[child].lengthMask;
+            if (mask == n.lengthMask) return;   // ancestors are unaffected
+            n.lengthMask = mask;
+            depth -= n.labelLen;
+            node = n.parent;
+        }
+    }
+
+    // Bulk-load sort key: the first 8 bytes big-endian (zero padded) decide
+    // most comparisons without touching the string itself
+    using SortKey = pair<uint64_t, string_view>;
+
+    static SortKey sortKey(string_view w) {
+        uint64_t prefix = 0;
+        for (size_t i = 0; i < 8; i++) prefix = prefix << 8 | (i < w.size() ? (unsigned char)w[i] : 0);
+        return {prefix, w};
+    }
+
+    // One-pass build of a fresh trie from sorted, unique words. The stack
+    // holds the previous word's path, so each word only creates what it does
+    // not share with its predecessor; masks are pushed up as nodes are popped.
+    void buildSorted(const vector<SortKey>* groups, int lo, int hi) {
+        struct Level {
+            int node;
+            size_t depth;       // length of the string up to the end of node
+        };
+        vector<Level> path{{0, 0}};
+        auto pop = [&] {
+            int node = path.back().node;
+            path.pop_back();
+            nodes[path.back().node].lengthMask |= nodes[node].lengthMask;
+            return node;
+        };
+
+        string_view prev;
+        for (int g = lo; g < hi; g++) {
+            for (auto& [prefix, w] : groups[g]) {
+                size_t lcp = 0, m = min(w.size(), prev.size());
+                while (lcp < m && w[lcp] == prev[lcp]) lcp++;
+
+                int last = -1;
+                while (path.back().depth > lcp) last = pop();
+                if (path.back().depth < lcp) {
+                    // w leaves the previous word's path inside last's label
+                    int mid = splitNode(path.back().node, last, lcp - path.back().depth);
+                    path.push_back({mid, lcp});
+                }
+
+                int cur = path.back().node;
+                if (w.size() > lcp) {
+                    cur = newNode(labelPool.size(), w.size() - lcp);
+                    labelPool.append(w.substr(lcp));
+                    nodes[cur].parent = path.back().node;
+                    addChild(nodes[cur].parent, cur);
+                    path.push_back({cur, w.size()});
+                }
+                nodes[cur].isEnd = true;
+                nodes[cur].lengthMask |= lengthBit(w.size());
+
+                if (byLength.size() <= w.size()) byLength.resize(w.size() + 1);
+                nodes[cur].bucketSlot = byLength[w.size()].size();
+                byLength[w.size()].push_back(cur);
+                prev = w;
+            }
         }
-        cur->isEnd = true;
+        while (path.size() > 1) pop();
     }
 
-    // Move to prefix node
-    TrieNode* trieGoto(const string& prefix) const {
-        TrieNode* cur = root;
-        for (char c : prefix) {
-            int idx = toIndex(c);
-            if (!cur->next[idx]) return nullptr;
-            cur = cur->next[idx];
+    // Splice in a trie built separately over a disjoint set of first bytes
+    void graft(Dictionary& part) {
+        int base = nodes.size() - 1;            // part's node i becomes base + i
+        uint32_t poolBase = labelPool.size();
+        labelPool += part.labelPool;
+
+        nodes.reserve(nodes.size() + part.nodes.size() - 1);
+        for (size_t i = 1; i < part.nodes.size(); i++) {
+            RadixNode& n = part.nodes[i];
+            n.labelOff += poolBase;
+            n.parent = n.parent == 0 ? 0 : n.parent + base;
+            n.children.shiftIds(base);
+            nodes.push_back(std::move(n));
+        }
+
+        const RadixNode& root = part.nodes[0];
+        nodes[0].isEnd |= root.isEnd;
+        nodes[0].lengthMask |= root.lengthMask;
+        for (int key = 0, child; (child = root.children.next(key)) >= 0; key++)
+            nodes[0].children.set(key, child + base);
+
+        if (byLength.size() < part.byLength.size()) byLength.resize(part.byLength.size());
+        for (size_t len = 0; len < part.byLength.size(); len++) {
+            for (int id : part.byLength[len]) {
+                int node = id == 0 ? 0 : id + base;
+                nodes[node].bucketSlot = byLength[len].size();
+                byLength[len].push_back(node);
+            }
         }
-        return cur;
     }
 
-    // DFS collect in lexicographic order
-    void collectWords(TrieNode* node, string& path, int n, vector<string>& out) const {
-        if (!node || out.size() >= (size_t)n) return;
+    // Move to prefix position
+    bool trieGoto(const string& prefix, Cursor& at) const {
+        int cur = 0;
+        size_t i = 0;
+        while (i < prefix.size()) {
+            int child = findChild(cur, prefix[i]);
+            if (child < 0) return false;
 
-        if (node->isEnd) {
+            uint32_t k = 0, len = nodes[child].labelLen;
+            while (k < len && i + k < prefix.size()) {
+                if (labelAt(child, k) != (unsigned char)prefix[i + k]) return false;
+                k++;
+            }
+            i += k;
+            cur = child;
+            if (k < len) { at = {cur, k}; return true; }
+        }
+        at = {cur, nodes[cur].labelLen};
+        return true;
+    }
+
+    // DFS collect in lexicographic order; path already spells node's label
+    void collectWords(int node, string& path, int n, vector<string>& out) const {
+        if (out.size() >= (size_t)n) return;
+
+        if (nodes[node].isEnd) {
             out.push_back(path);
             if (out.size() >= (size_t)n) return;
         }
 
-        for (int i = 0; i < ALPHABET; i++) {
-            if (node->next[i]) {
-                path.push_back(toChar(i));
-                collectWords(node->next[i], path, n, out);
-                path.pop_back();
+        for (int key = 0, child; (child = nodes[node].children.next(key)) >= 0; key++) {
+            const RadixNode& c = nodes[child];
+            path.append(labelPool, c.labelOff, c.labelLen);
+            collectWords(child, path, n, out);
+            path.resize(path.size() - c.labelLen);
 
-                if (out.size() >= (size_t)n) return;
-            }
+            if (out.size() >= (size_t)n) return;
         }
     }
 
-    // Wildcard DFS for pattern with '.' characters
-    bool existsDFS(TrieNode* node, const string& pat, int idx) const {
-        if (!node) return false;
+    // -------- Wildcard engine --------
+    static bool labelMatches(const string& pat, size_t idx, const char* label, uint32_t len) {
+        if (idx + len > pat.size()) return false;
+        for (uint32_t k = 0; k < len; k++)
+            if (pat[idx + k] != '.' && pat[idx + k] != label[k]) return false;
+        return true;
+    }
 
-        if (idx == pat.size())
-            return node->isEnd;
+    // Check a terminal node against the pattern by walking up to the root
+    bool matchesUpward(int node, const string& pat) const {
+        size_t pos = pat.size();
+        for (; node > 0; node = nodes[node].parent) {
+            const RadixNode& n = nodes[node];
+            if (n.labelLen > pos) return false;
+            pos -= n.labelLen;
+            if (!labelMatches(pat, pos, &labelPool[n.labelOff], n.labelLen)) return false;
+        }
+        return pos == 0;
+    }
 
-        char c = pat[idx];
+    string wordOf(int node) const {
+        string w;
+        for (; node > 0; node = nodes[node].parent) {
+            const RadixNode& n = nodes[node];
+            w.insert(0, labelPool, n.labelOff, n.labelLen);
+        }
+        return w;
+    }
+
+    // Words matching pat, in lexicographic order, stopping at limit. out may
+    // be null when only the count matters (no allocation then).
+    size_t matchPattern(const string& pat, size_t limit, vector<string>* out) const {
+        if (limit == 0 || !(nodes[0].lengthMask & lengthBit(pat.size()))) return 0;
 
-        if (c == '.') {
-            // Try all 26 options
-            for (int i = 0; i < ALPHABET; i++) {
-                if (node->next[i] &&
-                    existsDFS(node->next[i], pat, idx + 1))
-                    return true;
+        // few words of this length: test each one directly
+        if (pat.size() < byLength.size() && byLength[pat.size()].size() <= BUCKET_SCAN_LIMIT) {
+            size_t found = 0;
+            for (int node : byLength[pat.size()]) {
+                if (!matchesUpward(node, pat)) continue;
+                found++;
+                if (out) out->push_back(wordOf(node));
+                else if (found >= limit) break;
             }
-            return false;
+            if (out) {
+                sort(out->end() - found, out->end());
+                if (found > limit) out->resize(out->size() - (found - limit));
+            }
+            return min(found, limit);
+        }
+
+        // iterative DFS; frames and path buffer are reused across calls
+        struct Frame {
+            int node;
+            int next;           // next child key to try
+            uint32_t idx;       // pattern position after node's label
+        };
+        static thread_local vector<Frame> stack;
+        static thread_local string path;
+        stack.clear();
+        path.clear();
+
+        uint64_t bit = lengthBit(pat.size());
+        size_t found = 0;
+        if (pat.empty()) return 0;      // only the bucket can hold ""
+        stack.push_back({0, 0, 0});
+
+        while (!stack.empty()) {
+            Frame& f = stack.back();
+            const RadixNode& n = nodes[f.node];
+            if (out) path.resize(f.idx);
+
+            int child;
+            if (pat[f.idx] != '.') {
+                // exact byte: at most one child to try
+                if (f.next > 0) { stack.pop_back(); continue; }
+                f.next = 1;
+                child = findChild(f.node, pat[f.idx]);
+                if (child < 0) continue;
+            } else {
+                child = n.children.next(f.next);
+                if (child < 0) { stack.pop_back(); continue; }
+                f.next++;
+            }
+
+            const RadixNode& c = nodes[child];
+            if (!(c.lengthMask & bit)) continue;
+            if (!labelMatches(pat, f.idx, &labelPool[c.labelOff], c.labelLen)) continue;
+
+            uint32_t idx = f.idx + c.labelLen;
+            if (out) path.append(labelPool, c.labelOff, c.labelLen);
+            if (idx == pat.size()) {
+                if (c.isEnd) {
+                    found++;
+                    if (out) out->push_back(path);
+                    if (found >= limit) return found;
+                }
+                continue;
+            }
+            stack.push_back({child, 0, idx});
+        }
+        return found;
+    }
+
+    // -------- Fuzzy (edit distance) search --------
+    // Levenshtein DP with one row per trie depth: rows[d][j] is the distance
+    // of word[0..j) to the d-byte path, capped at maxDist + 1. Only the band
+    // |d - j| <= maxDist is computed. A subtree is dropped once its row
+    // minimum exceeds the bound or no word of a usable length lies below it.
+    struct FuzzyQuery {
+        const string& word;
+        int maxDist;
+        uint64_t lengths;                   // mask of word lengths within reach
+        vector<int>& rows;                  // (depth + 1) x (word.size() + 1)
+        string& path;
+        vector<pair<int, string>>& hits;
+    };
+
+    // Extend the DP by byte ch at depth d (rows[d] -> rows[d + 1]); false
+    // once every cell in the band exceeds the bound
+    bool fuzzyStep(FuzzyQuery& q, size_t d, char ch) const {
+        size_t m = q.word.size();
+        if (q.rows.size() < (d + 2) * (m + 1)) q.rows.resize((d + 2) * (m + 1));
+        const int* prev = &q.rows[d * (m + 1)];
+        int* row = &q.rows[(d + 1) * (m + 1)];
+        int cap = q.maxDist + 1;
+
+        size_t lo = d + 1 > (size_t)q.maxDist ? d + 1 - q.maxDist : 0;
+        size_t hi = min(m, d + 1 + q.maxDist);
+        int best = cap;
+        if (lo == 0) { row[0] = min(prev[0] + 1, cap); best = row[0]; lo = 1; }
+        else row[lo - 1] = cap;                 // left of the band
+        for (size_t j = lo; j <= hi; j++) {
+            row[j] = min({prev[j] + 1, row[j - 1] + 1,
+                          prev[j - 1] + (q.word[j - 1] != ch), cap});
+            best = min(best, row[j]);
         }
+        if (hi < m) row[hi + 1] = cap;          // right of the band
+        return best <= q.maxDist;
+    }
+
+    void fuzzyDFS(int node, size_t depth, FuzzyQuery& q) const {
+        size_t m = q.word.size();
+        const ChildMap& children = nodes[node].children;
+
+        for (int key = 0, child; (child = children.next(key)) >= 0; key++) {
+            // the key is the child's first label byte: test it before
+            // touching the child node at all
+            if (!fuzzyStep(q, depth, (char)key)) continue;
 
-        // exact match
-        int id = toIndex(c);
-        return existsDFS(node->next[id], pat, idx + 1);
+            const RadixNode& c = nodes[child];
+            if (!(c.lengthMask & q.lengths)) continue;
+
+            size_t d = depth + 1;
+            bool alive = true;
+            for (uint32_t k = 1; k < c.labelLen && alive; k++, d++)
+                alive = fuzzyStep(q, d, labelPool[c.labelOff + k]);
+            if (!alive) continue;
+
+            q.path.append(labelPool, c.labelOff, c.labelLen);
+            if (c.isEnd && d + q.maxDist >= m && d <= m + q.maxDist) {
+                int dist = q.rows[d * (m + 1) + m];
+                if (dist <= q.maxDist) q.hits.push_back({dist, q.path});
+            }
+            fuzzyDFS(child, d, q);
+            q.path.resize(q.path.size() - c.labelLen);
+        }
     }
 
 public:
     Dictionary() {
-        root = new TrieNode();
+        nodes.emplace_back();   // root
     }
 
     // 1) Insert or update a word
@@ -105,6 +660,63 @@ public:
         meanings[word] = meaning;  // overwrite/update
     }
 
+    // 1b) Bulk insert or update from (word, meaning) pairs; later duplicates
+    //     win. Words are bucketed by first byte and sorted once. An empty
+    //     dictionary is built in a single pass per bucket, split over up to
+    //     `threads` workers; otherwise words go in one by one in sorted order.
+    template <class Range>
+    void storeWords(const Range& entries, unsigned threads = 1) {
+        vector<SortKey> groups[257];            // 0: "", 1 + b: first byte b
+        size_t total = 0;
+        for (const auto& e : entries) {
+            string_view w = e.first;
+            groups[w.empty() ? 0 : 1 + (unsigned char)w[0]].push_back(sortKey(w));
+            total++;
+        }
+        auto sortGroups = [&](int lo, int hi) {
+            for (int g = lo; g < hi; g++) {
+                sort(groups[g].begin(), groups[g].end());
+                groups[g].erase(unique(groups[g].begin(), groups[g].end()), groups[g].end());
+            }
+        };
+
+        if (!meanings.empty()) {
+            sortGroups(0, 257);
+            for (auto& group : groups)
+                for (auto& [prefix, w] : group)
+                    if (meanings.find(string(w)) == meanings.end()) trieInsert(w);
+        } else if (threads <= 1) {
+            sortGroups(0, 257);
+            buildSorted(groups, 0, 257);
+        } else {
+            // contiguous runs of first bytes with roughly equal word counts
+            vector<int> cuts{0};
+            size_t seen = 0;
+            for (int g = 0; g < 257 && cuts.size() < threads; g++) {
+                seen += groups[g].size();
+                if (seen * threads >= total * cuts.size()) cuts.push_back(g + 1);
+            }
+            if (cuts.back() != 257) cuts.push_back(257);
+
+            vector<Dictionary> parts(cuts.size() - 1);
+            vector<thread> workers;
+            for (size_t t = 0; t + 1 < cuts.size(); t++) {
+                workers.emplace_back([&, t] {
+                    sortGroups(cuts[t], cuts[t + 1]);
+                    parts[t].buildSorted(groups, cuts[t], cuts[t + 1]);
+                });
+            }
+            meanings.reserve(total);
+            for (const auto& e : entries) meanings[e.first] = e.second;
+            for (auto& w : workers) w.join();
+            for (auto& part : parts) graft(part);
+            return;
+        }
+
+        meanings.reserve(meanings.size() + total);
+        for (const auto& e : entries) meanings[e.first] = e.second;
+    }
+
     // 2) Exact meaning
     string getMeaning(const string& word) const {
         auto it = meanings.find(word);
@@ -114,17 +726,499 @@ public:
     // 3) Prefix search
     vector<string> searchWords(const string& prefix, int n) const {
         vector<string> result;
-        TrieNode* node = trieGoto(prefix);
-        if (!node) return result;
+        Cursor at;
+        if (!trieGoto(prefix, at)) return result;
 
+        // complete the label the prefix stopped inside
+        const RadixNode& node = nodes[at.node];
         string path = prefix;
+        path.append(labelPool, node.labelOff + at.consumed, node.labelLen - at.consumed);
+        collectWords(at.node, path, n, result);
+        return result;
+    }
+
+    // 4) Wildcard exists
+    bool exists(const string& pattern) const {
+        return matchPattern(pattern, 1, nullptr) > 0;
+    }
+
+    // 4b) All words matching a wildcard pattern, lexicographic, at most limit
+    vector<string> matchWords(const string& pattern, int limit) const {
+        vector<string> result;
+        if (limit > 0) matchPattern(pattern, limit, &result);
+        return result;
+    }
+
+    // 4c) Words within maxDistance edits of word, closest first, at most n
+    vector<string> searchFuzzy(const string& word, int maxDistance, int n) const {
+        vector<string> result;
+        if (n <= 0 || maxDistance < 0) return result;
+
+        size_t m = word.size();
+        uint64_t lengths = 0;
+        for (size_t L = m > (size_t)maxDistance ? m - maxDistance : 0; L <= m + maxDistance; L++) {
+            lengths |= lengthBit(L);
+            if (L >= 63) break;
+        }
+
+        static thread_local vector<int> rows;
+        static thread_local string path;
+        vector<pair<int, string>> hits;
+        path.clear();
+        if (rows.size() < m + 1) rows.resize(m + 1);
+        for (size_t j = 0; j <= m; j++) rows[j] = min<int>(j, maxDistance + 1);   // empty path
+
+        if (nodes[0].isEnd && (int)m <= maxDistance) hits.push_back({(int)m, ""});
+        FuzzyQuery q{word, maxDistance, lengths, rows, path, hits};
+        fuzzyDFS(0, 0, q);
+
+        size_t keep = min(hits.size(), (size_t)n);
+        partial_sort(hits.begin(), hits.begin() + keep, hits.end());
+        for (size_t i = 0; i < keep; i++) result.push_back(std::move(hits[i].second));
+        return result;
+    }
+
+    // 5) Remove a word; emptied branches are pruned and their nodes reused
+    bool removeWord(const string& word) {
+        auto it = meanings.find(word);
+        if (it == meanings.end()) return false;
+        meanings.erase(it);
+
+        Cursor at{0, 0};
+        trieGoto(word, at);         // present, so this ends on its terminal node
+        int node = at.node;
+        size_t depth = word.size();
+        unbucket(node, depth);
+        nodes[node].isEnd = false;
+
+        if (node != 0 && nodes[node].children.empty()) {
+            int parent = nodes[node].parent;
+            nodes[parent].children.erase(labelAt(node, 0));
+            depth -= nodes[node].labelLen;
+            freeNode(node);
+            node = parent;
+        }
+        // an inner node left with one child and no word is a redundant split
+        if (node != 0 && !nodes[node].isEnd && nodes[node].children.size() == 1) {
+            int parent = nodes[node].parent;
+            depth -= nodes[node].labelLen;
+            mergeWithChild(node);
+            node = parent;
+        }
+        refreshMasks(node, depth);
+        return true;
+    }
+
+    // 6) Rebuild nodes and label pool densely in preorder, dropping free
+    //    slots and dead label bytes
+    void compact() {
+        vector<RadixNode> dense;
+        dense.reserve(nodes.size() - freeNodes.size());
+        string pool;
+        pool.reserve(labelPool.size() - deadLabelBytes);
+        vector<int> remap(nodes.size(), -1);
+
+        vector<int> stack{0}, kids;
+        while (!stack.empty()) {
+            int id = stack.back();
+            stack.pop_back();
+            const RadixNode& n = nodes[id];
+            remap[id] = dense.size();
+
+            dense.emplace_back();
+            RadixNode& d = dense.back();
+            d.labelOff = pool.size();
+            d.labelLen = n.labelLen;
+            d.isEnd = n.isEnd;
+            d.bucketSlot = n.bucketSlot;
+            d.parent = n.parent < 0 ? -1 : remap[n.parent];
+            d.lengthMask = n.lengthMask;
+            pool.append(labelPool, n.labelOff, n.labelLen);
+
+            kids.clear();
+            for (int key = 0, child; (child = n.children.next(key)) >= 0; key++) kids.push_back(child);
+            stack.insert(stack.end(), kids.rbegin(), kids.rend());
+        }
+
+        for (size_t id = 0; id < nodes.size(); id++) {
+            if (remap[id] < 0) continue;
+            RadixNode& d = dense[remap[id]];
+            for (int key = 0, child; (child = nodes[id].children.next(key)) >= 0; key++)
+                d.children.set(key, remap[child]);
+            d.children.shrink();
+        }
+        for (auto& bucket : byLength) {
+            for (int& id : bucket) id = remap[id];
+            bucket.shrink_to_fit();
+        }
+
+        nodes = std::move(dense);
+        labelPool = std::move(pool);
+        freeNodes.clear();
+        freeNodes.shrink_to_fit();
+        deadLabelBytes = 0;
+    }
+
+    // 7) Memory footprint; fragmentation is the share of node slots and
+    //    label bytes held but not in use, which compact() gives back
+    struct MemoryStats {
+        size_t nodes;           // live trie nodes
+        size_t freeNodes;       // released slots awaiting reuse
+        size_t words;
+        size_t bytes;           // approximate heap footprint
+        double fragmentation;
+    };
+
+    MemoryStats memoryStats() const {
+        MemoryStats st{};
+        st.nodes = nodes.size() - freeNodes.size();
+        st.freeNodes = freeNodes.size();
+        st.words = meanings.size();
+
+        size_t bytes = nodes.capacity() * sizeof(RadixNode) + labelPool.capacity() +
+                       freeNodes.capacity() * sizeof(int);
+        for (auto& n : nodes) bytes += n.children.bytes();
+        for (auto& bucket : byLength) bytes += sizeof(bucket) + bucket.capacity() * sizeof(int);
+        bytes += meanings.bucket_count() * sizeof(void*);
+        for (auto& [w, m] : meanings)
+            bytes += sizeof(pair<const string, string>) + 2 * sizeof(void*) +
+                     (w.capacity() > 15 ? w.capacity() : 0) + (m.capacity() > 15 ? m.capacity() : 0);
+        st.bytes = bytes;
+
+        size_t held = nodes.capacity() * sizeof(RadixNode) + labelPool.capacity();
+        size_t wasted = (nodes.capacity() - st.nodes) * sizeof(RadixNode) +
+                        (labelPool.capacity() - labelPool.size()) + deadLabelBytes;
+        st.fragmentation = held ? (double)wasted / held : 0.0;
+        return st;
+    }
+
+    // 8) Serialize trie + meanings into an image for MappedDictionary
+    void saveImage(const string& path) const {
+        vector<ImageNode> out(nodes.size());
+        vector<uint32_t> children;
+        vector<uint8_t> firstBytes;
+        string pool = labelPool;
+
+        // BFS so that each node's children get consecutive ids and slots
+        vector<pair<int, string>> queue{{0, ""}};
+        for (size_t head = 0; head < queue.size(); head++) {
+            int id = queue[head].first;
+            string word = queue[head].second;
+            const RadixNode& n = nodes[id];
+            ImageNode& img = out[head];
+
+            img = ImageNode{n.labelOff, 0, n.labelLen, 0,
+                            (uint32_t)children.size(), (uint32_t)n.children.size(),
+                            n.isEnd, 0};
+            if (n.isEnd) {
+                const string& m = meanings.at(word);
+                img.meaningOff = pool.size();
+                img.meaningLen = m.size();
+                pool += m;
+            }
+
+            for (int key = 0, child; (child = n.children.next(key)) >= 0; key++) {
+                children.push_back(queue.size());
+                firstBytes.push_back(key);
+                queue.push_back({child, word + labelPool.substr(nodes[child].labelOff,
+                                                                nodes[child].labelLen)});
+            }
+        }
+        out.resize(queue.size());
+
+        auto align8 = [](uint64_t x) { return (x + 7) & ~7ull; };
+        ImageHeader h{};
+        memcpy(h.magic, "DICTIMG1", 8);
+        h.nodeCount = out.size();
+        h.childCount = children.size();
+        h.nodesOff = align8(sizeof(ImageHeader));
+        h.childrenOff = align8(h.nodesOff + out.size() * sizeof(ImageNode));
+        h.firstBytesOff = h.childrenOff + children.size() * sizeof(uint32_t);
+        h.poolOff = h.firstBytesOff + firstBytes.size();
+        h.poolLen = pool.size();
+
+        string file(h.poolOff + pool.size(), '\0');
+        memcpy(&file[0], &h, sizeof(h));
+        memcpy(&file[h.nodesOff], out.data(), out.size() * sizeof(ImageNode));
+        memcpy(&file[h.childrenOff], children.data(), children.size() * sizeof(uint32_t));
+        memcpy(&file[h.firstBytesOff], firstBytes.data(), firstBytes.size());
+        memcpy(&file[h.poolOff], pool.data(), pool.size());
+
+        ofstream f(path, ios::binary | ios::trunc);
+        f.write(file.data(), file.size());
+        if (!f) throw runtime_error("cannot write dictionary image " + path);
+    }
+};
+
+// Read-only dictionary served straight from an mmap-ed image: no parsing, no
+// per-lookup allocation (beyond the result vector of searchWords)
+class MappedDictionary {
+private:
+    const char* base = nullptr;
+    size_t length = 0;
+    const ImageHeader* header;
+    const ImageNode* nodes;
+    const uint32_t* children;
+    const uint8_t* firstBytes;
+    const char* pool;
+
+    inline unsigned char labelAt(const ImageNode& n, uint32_t i) const {
+        return pool[n.labelOff + i];
+    }
+
+    int findChild(const ImageNode& n, unsigned char c) const {
+        const uint8_t* b = firstBytes + n.childBegin;
+        const uint8_t* e = b + n.childCount;
+        const uint8_t* it = lower_bound(b, e, c);
+        return (it != e && *it == c) ? (int)children[it - firstBytes] : -1;
+    }
+
+    // Same walk as Dictionary::trieGoto
+    bool walk(string_view prefix, int& node, uint32_t& consumed) const {
+        node = 0;
+        size_t i = 0;
+        while (i < prefix.size()) {
+            int child = findChild(nodes[node], prefix[i]);
+            if (child < 0) return false;
+
+            const ImageNode& c = nodes[child];
+            uint32_t k = 0;
+            while (k < c.labelLen && i + k < prefix.size()) {
+                if (labelAt(c, k) != (unsigned char)prefix[i + k]) return false;
+                k++;
+            }
+            i += k;
+            node = child;
+            if (k < c.labelLen) { consumed = k; return true; }
+        }
+        consumed = nodes[node].labelLen;
+        return true;
+    }
+
+    void collectWords(int id, string& path, int n, vector<string>& out) const {
+        if (out.size() >= (size_t)n) return;
+
+        const ImageNode& node = nodes[id];
+        if (node.isEnd) {
+            out.push_back(path);
+            if (out.size() >= (size_t)n) return;
+        }
+
+        for (uint32_t i = 0; i < node.childCount; i++) {
+            int child = children[node.childBegin + i];
+            const ImageNode& c = nodes[child];
+            path.append(pool + c.labelOff, c.labelLen);
+            collectWords(child, path, n, out);
+            path.resize(path.size() - c.labelLen);
+
+            if (out.size() >= (size_t)n) return;
+        }
+    }
+
+    bool existsDFS(int id, uint32_t consumed, string_view pat, size_t idx) const {
+        const ImageNode& n = nodes[id];
+        for (; consumed < n.labelLen; consumed++, idx++) {
+            if (idx == pat.size()) return false;
+            if (pat[idx] != '.' && (unsigned char)pat[idx] != labelAt(n, consumed))
+                return false;
+        }
+
+        if (idx == pat.size())
+            return n.isEnd;
+
+        if (pat[idx] == '.') {
+            for (uint32_t i = 0; i < n.childCount; i++)
+                if (existsDFS(children[n.childBegin + i], 0, pat, idx)) return true;
+            return false;
+        }
+
+        int child = findChild(n, pat[idx]);
+        return child >= 0 && existsDFS(child, 0, pat, idx);
+    }
+
+public:
+    explicit MappedDictionary(const string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw runtime_error("cannot open dictionary image " + path);
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ImageHeader)) {
+            close(fd);
+            throw runtime_error("bad dictionary image " + path);
+        }
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) throw runtime_error("cannot map dictionary image " + path);
+
+        base = (const char*)p;
+        length = st.st_size;
+        header = (const ImageHeader*)base;
+        if (memcmp(header->magic, "DICTIMG1", 8) != 0 ||
+            header->poolOff + header->poolLen > length)
+        {
+            munmap(p, length);
+            throw runtime_error("bad dictionary image " + path);
+        }
+
+        nodes = (const ImageNode*)(base + header->nodesOff);
+        children = (const uint32_t*)(base + header->childrenOff);
+        firstBytes = (const uint8_t*)(base + header->firstBytesOff);
+        pool = base + header->poolOff;
+    }
+
+    MappedDictionary(const MappedDictionary&) = delete;
+    MappedDictionary& operator=(const MappedDictionary&) = delete;
+
+    ~MappedDictionary() { munmap((void*)base, length); }
+
+    // Points into the mapping; valid while this object lives
+    string_view getMeaning(string_view word) const {
+        int node;
+        uint32_t consumed;
+        if (!walk(word, node, consumed)) return {};
+
+        const ImageNode& n = nodes[node];
+        if (!n.isEnd || consumed != n.labelLen) return {};
+        return string_view(pool + n.meaningOff, n.meaningLen);
+    }
+
+    vector<string> searchWords(string_view prefix, int n) const {
+        vector<string> result;
+        int node;
+        uint32_t consumed;
+        if (!walk(prefix, node, consumed)) return result;
+
+        const ImageNode& at = nodes[node];
+        string path(prefix);
+        path.append(pool + at.labelOff + consumed, at.labelLen - consumed);
         collectWords(node, path, n, result);
         return result;
     }
 
+    bool exists(string_view pattern) const {
+        return existsDFS(0, 0, pattern, 0);
+    }
+};
+
+// ---------------- Concurrent dictionary ----------------
+// Words are range-sharded by first byte. Each shard keeps two Dictionary
+// replicas under the left-right protocol: readers are wait-free (two atomic
+// increments around a plain read of the active replica) and never see a
+// write in progress; a writer takes the shard's mutex, updates the idle
+// replica, flips readers over, waits for the old replica to drain and then
+// replays the update on it.
+class ConcurrentDictionary {
+private:
+    // Reader counter striped over cache lines to keep arrive/depart cheap
+    class ReadIndicator {
+        static constexpr int STRIPES = 32;
+        struct alignas(64) Counter { atomic<long> n{0}; };
+        Counter counters[STRIPES];
+
+        static int stripe() {
+            static thread_local int s = hash<thread::id>{}(this_thread::get_id()) % STRIPES;
+            return s;
+        }
+
+    public:
+        void arrive() { counters[stripe()].n.fetch_add(1); }
+        void depart() { counters[stripe()].n.fetch_sub(1, memory_order_release); }
+
+        bool empty() const {
+            for (auto& c : counters) if (c.n.load() != 0) return false;
+            return true;
+        }
+    };
+
+    struct Shard {
+        Dictionary replicas[2];
+        atomic<int> leftRight{0};       // replica readers use
+        atomic<int> versionIndex{0};    // read indicator new readers use
+        ReadIndicator readers[2];
+        mutex writeLock;
+    };
+
+    vector<unique_ptr<Shard>> shards;
+
+    Shard& shardFor(const string& key) const {
+        unsigned char first = key.empty() ? 0 : key[0];
+        return *shards[first * shards.size() / 256];
+    }
+
+    template <class F>
+    static auto read(Shard& s, F&& f) {
+        int vi = s.versionIndex.load();
+        s.readers[vi].arrive();
+        auto result = f(s.replicas[s.leftRight.load()]);
+        s.readers[vi].depart();
+        return result;
+    }
+
+    template <class F>
+    static void write(Shard& s, F&& f) {
+        lock_guard<mutex> guard(s.writeLock);
+        int lr = s.leftRight.load();
+        f(s.replicas[1 - lr]);
+        s.leftRight.store(1 - lr);
+
+        // wait out every reader that may still be on replica lr
+        int vi = s.versionIndex.load();
+        while (!s.readers[1 - vi].empty()) this_thread::yield();
+        s.versionIndex.store(1 - vi);
+        while (!s.readers[vi].empty()) this_thread::yield();
+
+        f(s.replicas[lr]);
+    }
+
+public:
+    explicit ConcurrentDictionary(int shardCount = 16) {
+        for (int i = 0; i < shardCount; i++) shards.push_back(make_unique<Shard>());
+    }
+
+    // 1) Insert or update a word (serialized per shard)
+    void storeWord(const string& word, const string& meaning) {
+        write(shardFor(word), [&](Dictionary& d) { d.storeWord(word, meaning); });
+    }
+
+    // 2) Exact meaning
+    string getMeaning(const string& word) const {
+        return read(shardFor(word), [&](const Dictionary& d) { return d.getMeaning(word); });
+    }
+
+    // 3) Prefix search; shards are byte ranges, so concatenation stays sorted
+    vector<string> searchWords(const string& prefix, int n) const {
+        if (!prefix.empty())
+            return read(shardFor(prefix), [&](const Dictionary& d) { return d.searchWords(prefix, n); });
+
+        vector<string> result;
+        for (auto& s : shards) {
+            if (result.size() >= (size_t)n) break;
+            auto part = read(*s, [&](const Dictionary& d) { return d.searchWords("", n - result.size()); });
+            result.insert(result.end(), part.begin(), part.end());
+        }
+        return result;
+    }
+
     // 4) Wildcard exists
     bool exists(const string& pattern) const {
-        return existsDFS(root, pattern, 0);
+        if (!pattern.empty() && pattern[0] != '.')
+            return read(shardFor(pattern), [&](const Dictionary& d) { return d.exists(pattern); });
+
+        for (auto& s : shards)
+            if (read(*s, [&](const Dictionary& d) { return d.exists(pattern); })) return true;
+        return false;
+    }
+
+    // 5) Remove a word
+    bool removeWord(const string& word) {
+        bool removed = false;
+        write(shardFor(word), [&](Dictionary& d) { removed = d.removeWord(word); });
+        return removed;
+    }
+
+    // 6) Compact every shard (both replicas)
+    void compact() {
+        for (auto& s : shards) write(*s, [](Dictionary& d) { d.compact(); });
     }
 };
 
@@ -142,9 +1236,15 @@ int main() {
     cout << dict.exists("a....") << endl;              // true (apple, apply)
     cout << dict.exists("c.t") << endl;                // true
     cout << dict.exists(".....") << endl;              // true (apple/apply)
+    cout << dict.searchFuzzy("aple", 1, 3)[0] << endl;  // apple
 
     auto v = dict.searchWords("ap", 5);
     for (auto& w : v) cout << w << endl;             // apple, apply, apt
 
+    dict.saveImage("dict.img");
+    MappedDictionary image("dict.img");
+    cout << image.getMeaning("apt") << endl;         // suitable
+    cout << image.exists("c.t") << endl;             // true
+
     return 0;
 }
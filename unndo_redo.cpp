@@ -1,137 +1,1356 @@
 #include <bits/stdc++.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 using namespace std;
 
-// Forward declarations
-class TextEditor;
+// Random heap priority for the treaps below
+static uint32_t treapPriority() {
+    static thread_local mt19937 rng(random_device{}());
+    return rng();
+}
 
-// -------- Command base --------
-class ICommand {
+// ----------------------
+// Rope
+// ----------------------
+// Chunked treap keyed by character position. Nodes are immutable and shared,
+// so copying a Rope is O(1) and every edit path-copies O(log n) nodes.
+class Rope {
+    struct Node {
+        string chunk;
+        uint32_t prio = 0;
+        size_t size = 0;                  // chars in this subtree
+        shared_ptr<const Node> left, right;
+    };
+    using Ptr = shared_ptr<const Node>;
+
+    static const size_t CHUNK = 512;      // chunk size used when building
+    static const size_t MAX_CHUNK = 1024; // in-place edits may grow a chunk up to this
+
+    Ptr root;
+
+    static size_t sz(const Ptr& t) { return t ? t->size : 0; }
+
+    static Ptr make(string chunk, uint32_t prio, Ptr l, Ptr r) {
+        auto n = make_shared<Node>();
+        n->size = sz(l) + chunk.size() + sz(r);
+        n->chunk = std::move(chunk);
+        n->prio = prio;
+        n->left = std::move(l);
+        n->right = std::move(r);
+        return n;
+    }
+
+    // Cartesian-tree build over fixed-size chunks: O(n)
+    static Ptr build(string_view s) {
+        vector<shared_ptr<Node>> spine;
+        auto seal = [](const shared_ptr<Node>& n) {
+            n->size = sz(n->left) + n->chunk.size() + sz(n->right);
+        };
+
+        for (size_t i = 0; i < s.size(); i += CHUNK) {
+            auto n = make_shared<Node>();
+            n->chunk = string(s.substr(i, CHUNK));
+            n->prio = treapPriority();
+
+            shared_ptr<Node> last;
+            while (!spine.empty() && spine.back()->prio < n->prio) {
+                last = spine.back(); spine.pop_back();
+                seal(last);
+            }
+            n->left = last;
+            if (!spine.empty()) spine.back()->right = n;
+            spine.push_back(n);
+        }
+
+        if (spine.empty()) return nullptr;
+        for (int i = (int)spine.size() - 1; i >= 0; i--) seal(spine[i]);
+        return spine.front();
+    }
+
+    // left gets the first pos chars
+    static pair<Ptr, Ptr> split(const Ptr& t, size_t pos) {
+        if (!t) return {nullptr, nullptr};
+
+        size_t ls = sz(t->left);
+        if (pos <= ls) {
+            auto [a, b] = split(t->left, pos);
+            return {a, make(t->chunk, t->prio, b, t->right)};
+        }
+        pos -= ls;
+        if (pos >= t->chunk.size()) {
+            auto [a, b] = split(t->right, pos - t->chunk.size());
+            return {make(t->chunk, t->prio, t->left, a), b};
+        }
+        // cut inside this chunk
+        return {make(t->chunk.substr(0, pos), t->prio, t->left, nullptr),
+                make(t->chunk.substr(pos), t->prio, nullptr, t->right)};
+    }
+
+    static Ptr merge(const Ptr& a, const Ptr& b) {
+        if (!a) return b;
+        if (!b) return a;
+        if (a->prio > b->prio)
+            return make(a->chunk, a->prio, a->left, merge(a->right, b));
+        return make(b->chunk, b->prio, merge(a, b->left), b->right);
+    }
+
+    // Insert inside the chunk holding pos; nullptr if that chunk would overflow
+    static Ptr insertLocal(const Ptr& t, size_t pos, string_view text) {
+        size_t ls = sz(t->left);
+        if (pos < ls) {
+            Ptr l = insertLocal(t->left, pos, text);
+            return l ? make(t->chunk, t->prio, l, t->right) : nullptr;
+        }
+        pos -= ls;
+        if (pos <= t->chunk.size()) {
+            if (t->chunk.size() + text.size() > MAX_CHUNK) return nullptr;
+            string c = t->chunk;
+            c.insert(pos, text);
+            return make(std::move(c), t->prio, t->left, t->right);
+        }
+        Ptr r = insertLocal(t->right, pos - t->chunk.size(), text);
+        return r ? make(t->chunk, t->prio, t->left, r) : nullptr;
+    }
+
+    // Erase a range that lies strictly inside one chunk; nullptr otherwise
+    static Ptr eraseLocal(const Ptr& t, size_t pos, size_t len) {
+        size_t ls = sz(t->left);
+        if (pos < ls) {
+            Ptr l = eraseLocal(t->left, pos, len);
+            return l ? make(t->chunk, t->prio, l, t->right) : nullptr;
+        }
+        pos -= ls;
+        if (pos < t->chunk.size()) {
+            if (pos + len > t->chunk.size() || len == t->chunk.size()) return nullptr;
+            string c = t->chunk;
+            c.erase(pos, len);
+            return make(std::move(c), t->prio, t->left, t->right);
+        }
+        Ptr r = eraseLocal(t->right, pos - t->chunk.size(), len);
+        return r ? make(t->chunk, t->prio, t->left, r) : nullptr;
+    }
+
+    static void appendRange(const Ptr& t, size_t pos, size_t len, string& out) {
+        if (!t || len == 0) return;
+
+        size_t ls = sz(t->left);
+        if (pos < ls) {
+            size_t take = min(len, ls - pos);
+            appendRange(t->left, pos, take, out);
+            pos += take; len -= take;
+            if (len == 0) return;
+        }
+        pos -= ls;
+        if (pos < t->chunk.size()) {
+            size_t take = min(len, t->chunk.size() - pos);
+            out.append(t->chunk, pos, take);
+            pos += take; len -= take;
+            if (len == 0) return;
+        }
+        appendRange(t->right, pos - t->chunk.size(), len, out);
+    }
+
+public:
+    Rope() = default;
+    explicit Rope(string_view s) : root(build(s)) {}
+
+    size_t size() const { return sz(root); }
+
+    void insert(size_t pos, string_view text) {
+        if (pos > size()) throw out_of_range("Rope::insert: position past end");
+        if (text.empty()) return;
+        if (root && text.size() <= MAX_CHUNK) {
+            if (Ptr t = insertLocal(root, pos, text)) { root = t; return; }
+        }
+        auto [a, b] = split(root, pos);
+        root = merge(merge(a, build(text)), b);
+    }
+
+    // Removes [pos, pos+len) clamped to the end, appending the removed text to out
+    void erase(size_t pos, size_t len, string& out) {
+        if (pos > size()) throw out_of_range("Rope::erase: position past end");
+        if (pos == size()) return;
+        len = min(len, size() - pos);
+        appendRange(root, pos, len, out);
+        if (len == 0) return;
+
+        if (Ptr t = eraseLocal(root, pos, len)) { root = t; return; }
+        auto [a, rest] = split(root, pos);
+        auto [mid, b] = split(rest, len);
+        root = merge(a, b);
+    }
+
+    string substr(size_t pos, size_t len) const {
+        string out;
+        if (pos >= size()) return out;
+        len = min(len, size() - pos);
+        out.reserve(len);
+        appendRange(root, pos, len, out);
+        return out;
+    }
+
+    string toString() const { return substr(0, size()); }
+};
+
+// ----------------------
+// RowTree
+// ----------------------
+// Persistent treap of Rope rows keyed by row index. Like Rope it shares
+// structure between copies, so a whole document copies in O(1).
+class RowTree {
+    struct Node {
+        Rope line;
+        uint32_t prio = 0;
+        int size = 0;                     // rows in this subtree
+        shared_ptr<const Node> left, right;
+    };
+    using Ptr = shared_ptr<const Node>;
+
+    Ptr root;
+
+    static int sz(const Ptr& t) { return t ? t->size : 0; }
+
+    static Ptr make(Rope line, uint32_t prio, Ptr l, Ptr r) {
+        auto n = make_shared<Node>();
+        n->size = sz(l) + 1 + sz(r);
+        n->line = std::move(line);
+        n->prio = prio;
+        n->left = std::move(l);
+        n->right = std::move(r);
+        return n;
+    }
+
+    // Cartesian-tree build, same scheme as Rope::build
+    static Ptr build(vector<Rope>& lines) {
+        vector<shared_ptr<Node>> spine;
+        auto seal = [](const shared_ptr<Node>& n) {
+            n->size = sz(n->left) + 1 + sz(n->right);
+        };
+
+        for (auto& line : lines) {
+            auto n = make_shared<Node>();
+            n->line = std::move(line);
+            n->prio = treapPriority();
+
+            shared_ptr<Node> last;
+            while (!spine.empty() && spine.back()->prio < n->prio) {
+                last = spine.back(); spine.pop_back();
+                seal(last);
+            }
+            n->left = last;
+            if (!spine.empty()) spine.back()->right = n;
+            spine.push_back(n);
+        }
+
+        if (spine.empty()) return nullptr;
+        for (int i = (int)spine.size() - 1; i >= 0; i--) seal(spine[i]);
+        return spine.front();
+    }
+
+    // left gets the first k rows
+    static pair<Ptr, Ptr> split(const Ptr& t, int k) {
+        if (!t) return {nullptr, nullptr};
+        if (k <= sz(t->left)) {
+            auto [a, b] = split(t->left, k);
+            return {a, make(t->line, t->prio, b, t->right)};
+        }
+        auto [a, b] = split(t->right, k - sz(t->left) - 1);
+        return {make(t->line, t->prio, t->left, a), b};
+    }
+
+    static Ptr merge(const Ptr& a, const Ptr& b) {
+        if (!a) return b;
+        if (!b) return a;
+        if (a->prio > b->prio)
+            return make(a->line, a->prio, a->left, merge(a->right, b));
+        return make(b->line, b->prio, merge(a, b->left), b->right);
+    }
+
+    static Ptr assign(const Ptr& t, int i, Rope line) {
+        int ls = sz(t->left);
+        if (i < ls) return make(t->line, t->prio, assign(t->left, i, std::move(line)), t->right);
+        if (i > ls) return make(t->line, t->prio, t->left, assign(t->right, i - ls - 1, std::move(line)));
+        return make(std::move(line), t->prio, t->left, t->right);
+    }
+
+public:
+    int size() const { return sz(root); }
+
+    const Rope& at(int i) const {
+        const Node* t = root.get();
+        for (;;) {
+            int ls = sz(t->left);
+            if (i < ls) { t = t->left.get(); continue; }
+            if (i == ls) return t->line;
+            i -= ls + 1;
+            t = t->right.get();
+        }
+    }
+
+    void set(int i, Rope line) { root = assign(root, i, std::move(line)); }
+
+    void insert(int i, vector<Rope> lines) {
+        auto [a, b] = split(root, i);
+        root = merge(merge(a, build(lines)), b);
+    }
+
+    void erase(int i, int n) {
+        auto [a, rest] = split(root, i);
+        auto [mid, b] = split(rest, n);
+        root = merge(a, b);
+    }
+};
+
+// ----------------------
+// Line storage backends
+// ----------------------
+class ILineStorage {
+public:
+    virtual ~ILineStorage() = default;
+    virtual int rowCount() const = 0;
+    virtual void insertRows(int row, const vector<string>& lines) = 0;   // one block move
+    virtual void eraseRows(int row, int n) = 0;
+    virtual void insert(int row, int col, string_view text) = 0;
+    virtual void erase(int row, int col, int length, string& removed) = 0;  // appends removed text
+    virtual string line(int row) const = 0;
+    virtual int lineLength(int row) const = 0;
+    virtual unique_ptr<ILineStorage> clone() const = 0;
+};
+
+// One std::string per row: cheap for short lines, O(line length) per edit
+class VectorLineStorage : public ILineStorage {
+public:
+    int rowCount() const override { return rows.size(); }
+
+    void insertRows(int row, const vector<string>& lines) override {
+        rows.insert(rows.begin() + row, lines.begin(), lines.end());
+    }
+
+    void eraseRows(int row, int n) override {
+        rows.erase(rows.begin() + row, rows.begin() + row + n);
+    }
+
+    void insert(int row, int col, string_view text) override {
+        rows[row].insert(col, text);
+    }
+
+    void erase(int row, int col, int length, string& removed) override {
+        removed.append(rows[row], col, length);
+        rows[row].erase(col, length);
+    }
+
+    string line(int row) const override { return rows[row]; }
+    int lineLength(int row) const override { return rows[row].size(); }
+
+    // Deep copy: O(document size)
+    unique_ptr<ILineStorage> clone() const override {
+        return make_unique<VectorLineStorage>(*this);
+    }
+
+private:
+    vector<string> rows;
+};
+
+// One Rope per row in a RowTree: O(log n) edits, suited to huge single-line
+// documents, and fully persistent so clone() is O(1)
+class RopeLineStorage : public ILineStorage {
+public:
+    int rowCount() const override { return rows.size(); }
+
+    void insertRows(int row, const vector<string>& lines) override {
+        vector<Rope> block;
+        block.reserve(lines.size());
+        for (auto& l : lines) block.emplace_back(l);
+        rows.insert(row, std::move(block));
+    }
+
+    void eraseRows(int row, int n) override { rows.erase(row, n); }
+
+    void insert(int row, int col, string_view text) override {
+        Rope r = rows.at(row);
+        if (col < 0 || (size_t)col > r.size()) throw out_of_range("RopeLineStorage::insert: column past end");
+        r.insert(col, text);
+        rows.set(row, std::move(r));
+    }
+
+    void erase(int row, int col, int length, string& removed) override {
+        Rope r = rows.at(row);
+        if (col < 0 || (size_t)col > r.size()) throw out_of_range("RopeLineStorage::erase: column past end");
+        r.erase(col, length, removed);
+        rows.set(row, std::move(r));
+    }
+
+    string line(int row) const override { return rows.at(row).toString(); }
+    int lineLength(int row) const override { return rows.at(row).size(); }
+
+    unique_ptr<ILineStorage> clone() const override {
+        return make_unique<RopeLineStorage>(*this);
+    }
+
+private:
+    RowTree rows;
+};
+
+// ----------------------
+// OperationLog
+// ----------------------
+// Write-ahead log of storage mutations at <path>, compacted into <path>.snap.
+// Each frame is one whole edit (or transaction) guarded by a CRC, so a torn
+// tail after a crash is detected and cut off. Frames are buffered and written
+// with one fdatasync per group. A snapshot carries a generation number; log
+// frames from an older generation are ignored, which makes compaction
+// crash-safe at every step.
+static uint32_t crc32(const char* data, size_t n, uint32_t crc = 0) {
+    static const auto table = [] {
+        array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) crc = table[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+class OperationLog {
+public:
+    enum Op : uint8_t { INSERT = 1, ERASE = 2, INSERT_ROWS = 3, ERASE_ROWS = 4 };
+
+    OperationLog(const string& path, size_t groupBytes)
+        : logPath(path), snapPath(path + ".snap"), groupLimit(groupBytes) {}
+
+    ~OperationLog() {
+        if (fd < 0) return;
+        try {
+            sync();
+        } catch (const exception&) {
+            // unreportable here; the unsynced frames are lost as in a crash
+        }
+        close(fd);
+    }
+
+    // Load the snapshot and replay the log into an empty storage
+    void recover(ILineStorage& into) {
+        uint64_t snapGen = loadSnapshot(into);
+
+        fd = open(logPath.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) throw runtime_error("cannot open log " + logPath);
+
+        size_t valid = replayLog(into, snapGen);
+        if (valid == 0) {
+            // new, foreign or superseded log: drop its frames, or they would
+            // be replayed under the current generation on the next reopen
+            if (ftruncate(fd, 0) != 0) throw runtime_error("cannot truncate log " + logPath);
+            writeHeader(snapGen);
+        } else if (ftruncate(fd, valid) != 0) {
+            throw runtime_error("cannot truncate log " + logPath);
+        }
+        generation = snapGen;
+        fileEnd = max(valid, HEADER_SIZE);
+    }
+
+    // -------- recording (called by LoggedLineStorage) --------
+    void logInsert(int row, int col, string_view text) {
+        putOp(INSERT); put32(row); put32(col); putText(text);
+    }
+
+    void logErase(int row, int col, int length) {
+        putOp(ERASE); put32(row); put32(col); put32(length);
+    }
+
+    void logInsertRows(int row, const vector<string>& lines) {
+        putOp(INSERT_ROWS); put32(row); put32(lines.size());
+        for (auto& l : lines) putText(l);
+    }
+
+    void logEraseRows(int row, int n) {
+        putOp(ERASE_ROWS); put32(row); put32(n);
+    }
+
+    // Close the current frame; the edit becomes durable with the next group
+    void endEdit() {
+        if (frame.empty()) return;
+
+        uint32_t len = frame.size();
+        uint32_t crc = crc32(frame.data(), frame.size());
+        buffer.append((const char*)&len, 4);
+        buffer.append((const char*)&crc, 4);
+        buffer += frame;
+        frame.clear();
+
+        if (buffer.size() >= groupLimit) sync();
+    }
+
+    // Write all closed frames with a single fdatasync
+    void sync() {
+        if (buffer.empty()) return;
+        writeAt(fileEnd, buffer);
+        if (fdatasync(fd) != 0) throw runtime_error("fdatasync failed on " + logPath);
+        fileEnd += buffer.size();
+        buffer.clear();
+    }
+
+    // Bound reload time: compact once the log outgrows the document
+    bool wantsCompaction() const {
+        return fileEnd + buffer.size() > max(COMPACT_MIN_BYTES, 2 * snapshotBytes);
+    }
+
+    // Replace snapshot + log by a snapshot of `doc` (the current document)
+    void compact(const ILineStorage& doc) {
+        uint64_t next = generation + 1;
+        frame.clear();
+        buffer.clear();     // everything buffered is already part of doc
+
+        string out;
+        out.append(SNAP_MAGIC, 4);
+        out.append((const char*)&next, 8);
+        uint64_t rows = doc.rowCount();
+        out.append((const char*)&rows, 8);
+        for (int r = 0; r < doc.rowCount(); r++) {
+            string line = doc.line(r);
+            uint32_t len = line.size();
+            out.append((const char*)&len, 4);
+            out += line;
+        }
+        uint32_t crc = crc32(out.data(), out.size());
+        out.append((const char*)&crc, 4);
+
+        string tmp = snapPath + ".tmp";
+        int sfd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (sfd < 0) throw runtime_error("cannot write snapshot " + tmp);
+        try {
+            writeAll(sfd, out.data(), out.size());
+        } catch (...) {
+            close(sfd);
+            throw;
+        }
+        if (fsync(sfd) != 0) {
+            close(sfd);
+            throw runtime_error("fsync failed on " + tmp);
+        }
+        close(sfd);
+        if (rename(tmp.c_str(), snapPath.c_str()) != 0)
+            throw runtime_error("cannot install snapshot " + snapPath);
+        syncDirectory();
+
+        // a crash before this point leaves an older-generation log: ignored
+        if (ftruncate(fd, 0) != 0) throw runtime_error("cannot truncate log " + logPath);
+        writeHeader(next);
+        generation = next;
+        fileEnd = HEADER_SIZE;
+        snapshotBytes = out.size();
+    }
+
+private:
+    static constexpr const char* LOG_MAGIC = "TELG";
+    static constexpr const char* SNAP_MAGIC = "TESN";
+    static constexpr size_t HEADER_SIZE = 12;           // magic + generation
+    static constexpr size_t COMPACT_MIN_BYTES = 4 << 20;
+
+    string logPath, snapPath;
+    size_t groupLimit;
+    int fd = -1;
+    uint64_t generation = 0;
+    size_t fileEnd = 0;
+    size_t snapshotBytes = 0;
+
+    string frame;       // ops of the edit in progress
+    string buffer;      // closed frames waiting for the next group write
+
+    void putOp(Op op) { frame.push_back((char)op); }
+    void put32(uint32_t v) { frame.append((const char*)&v, 4); }
+    void putText(string_view s) { put32(s.size()); frame.append(s); }
+
+    // -------- file helpers --------
+    static void writeAll(int f, const char* p, size_t n) {
+        while (n > 0) {
+            ssize_t w = write(f, p, n);
+            if (w < 0) throw runtime_error("write failed");
+            p += w; n -= w;
+        }
+    }
+
+    void writeAt(size_t offset, const string& data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t w = pwrite(fd, data.data() + done, data.size() - done, offset + done);
+            if (w < 0) throw runtime_error("write failed on " + logPath);
+            done += w;
+        }
+    }
+
+    void writeHeader(uint64_t gen) {
+        string h(LOG_MAGIC, 4);
+        h.append((const char*)&gen, 8);
+        writeAt(0, h);
+        if (fdatasync(fd) != 0) throw runtime_error("fdatasync failed on " + logPath);
+    }
+
+    void syncDirectory() {
+        size_t slash = snapPath.rfind('/');
+        string dir = slash == string::npos ? "." : snapPath.substr(0, slash + 1);
+        int dfd = open(dir.c_str(), O_RDONLY);
+        if (dfd >= 0) { fsync(dfd); close(dfd); }
+    }
+
+    // Read-only mapping of a whole file; empty view if missing or empty
+    struct Mapping {
+        const char* data = nullptr;
+        size_t size = 0;
+        ~Mapping() { if (data) munmap((void*)data, size); }
+    };
+
+    static bool mapFile(int f, Mapping& m) {
+        struct stat st;
+        if (fstat(f, &st) != 0 || st.st_size == 0) return false;
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, f, 0);
+        if (p == MAP_FAILED) return false;
+        m.data = (const char*)p;
+        m.size = st.st_size;
+        return true;
+    }
+
+    static uint32_t get32(const char*& p) { uint32_t v; memcpy(&v, p, 4); p += 4; return v; }
+    static uint64_t get64(const char*& p) { uint64_t v; memcpy(&v, p, 8); p += 8; return v; }
+
+    // Bulk-load the snapshot in one insertRows; returns its generation
+    uint64_t loadSnapshot(ILineStorage& into) {
+        int sfd = open(snapPath.c_str(), O_RDONLY);
+        if (sfd < 0) return 0;
+
+        Mapping m;
+        bool mapped = mapFile(sfd, m);
+        close(sfd);
+        if (!mapped || m.size < 24 || memcmp(m.data, SNAP_MAGIC, 4) != 0)
+            throw runtime_error("corrupt snapshot " + snapPath);
+
+        const char* end = m.data + m.size - 4;
+        const char* tail = end;
+        if (get32(tail) != crc32(m.data, m.size - 4))
+            throw runtime_error("corrupt snapshot " + snapPath);
+
+        const char* p = m.data + 4;
+        uint64_t gen = get64(p);
+        uint64_t rows = get64(p);
+        vector<string> lines;
+        lines.reserve(rows);
+        for (uint64_t r = 0; r < rows; r++) {
+            uint32_t len = get32(p);
+            lines.emplace_back(p, len);
+            p += len;
+        }
+        if (rows > 0) into.insertRows(0, lines);
+        snapshotBytes = m.size;
+        return gen;
+    }
+
+    // Apply every intact frame of the current generation; returns the byte
+    // length of the valid log prefix (0 if the log must be rewritten)
+    size_t replayLog(ILineStorage& into, uint64_t snapGen) {
+        Mapping m;
+        if (!mapFile(fd, m)) return 0;
+        if (m.size < HEADER_SIZE || memcmp(m.data, LOG_MAGIC, 4) != 0) return 0;
+
+        const char* p = m.data + 4;
+        if (get64(p) != snapGen) return 0;
+
+        const char* end = m.data + m.size;
+        string sink;
+        vector<string> lines;
+        while (end - p >= 8) {
+            const char* q = p;
+            uint32_t len = get32(q);
+            uint32_t crc = get32(q);
+            if ((size_t)(end - q) < len || crc32(q, len) != crc) break;  // torn tail
+
+            const char* fend = q + len;
+            while (q < fend) {
+                uint8_t op = *q++;
+                uint32_t row = get32(q);
+                if (op == INSERT) {
+                    uint32_t col = get32(q), n = get32(q);
+                    into.insert(row, col, string_view(q, n));
+                    q += n;
+                } else if (op == ERASE) {
+                    uint32_t col = get32(q), n = get32(q);
+                    sink.clear();
+                    into.erase(row, col, n, sink);
+                } else if (op == INSERT_ROWS) {
+                    uint32_t count = get32(q);
+                    lines.clear();
+                    for (uint32_t i = 0; i < count; i++) {
+                        uint32_t n = get32(q);
+                        lines.emplace_back(q, n);
+                        q += n;
+                    }
+                    into.insertRows(row, lines);
+                } else {
+                    into.eraseRows(row, get32(q));
+                }
+            }
+            p = fend;
+        }
+        return p - m.data;
+    }
+};
+
+// Storage decorator that records every mutation in an OperationLog
+class LoggedLineStorage : public ILineStorage {
 public:
-    virtual ~ICommand() = default;
-    virtual void apply() = 0;     // do/redo
-    virtual void unapply() = 0;   // undo
+    LoggedLineStorage(unique_ptr<ILineStorage> backend, OperationLog* wal)
+        : inner(std::move(backend)), log(wal) {}
+
+    int rowCount() const override { return inner->rowCount(); }
+
+    void insertRows(int row, const vector<string>& lines) override {
+        log->logInsertRows(row, lines);
+        inner->insertRows(row, lines);
+    }
+
+    void eraseRows(int row, int n) override {
+        log->logEraseRows(row, n);
+        inner->eraseRows(row, n);
+    }
+
+    void insert(int row, int col, string_view text) override {
+        log->logInsert(row, col, text);
+        inner->insert(row, col, text);
+    }
+
+    void erase(int row, int col, int length, string& removed) override {
+        log->logErase(row, col, length);
+        inner->erase(row, col, length, removed);
+    }
+
+    string line(int row) const override { return inner->line(row); }
+    int lineLength(int row) const override { return inner->lineLength(row); }
+
+    // Versions are frozen copies, so they are not logged
+    unique_ptr<ILineStorage> clone() const override { return inner->clone(); }
+
+private:
+    unique_ptr<ILineStorage> inner;
+    OperationLog* log;
+};
+
+// ----------------------
+// ReadPublisher
+// ----------------------
+// Single-writer / multi-reader publication of immutable document copies with
+// epoch-based reclamation. A reader announces the epoch it reads in, loads the
+// current copy and reads it, never locking or waiting. The writer frees a
+// retired copy once every active reader has announced a later epoch.
+class ReadPublisher {
+public:
+    explicit ReadPublisher(int maxReaders)
+        : slots(new Slot[maxReaders]), slotCount(maxReaders) {}
+
+    // Readers must be gone by now
+    ~ReadPublisher() {
+        delete current.load();
+        for (auto& r : retired) delete r.first;
+    }
+
+    // Writer: make `doc` visible to readers and reclaim what nobody can see
+    void publish(unique_ptr<const ILineStorage> doc) {
+        const ILineStorage* old = current.exchange(doc.release());
+        if (old) retired.push_back({old, globalEpoch.fetch_add(1)});
+        reclaim();
+    }
+
+    int acquireSlot() {
+        for (int i = 0; i < slotCount; i++) {
+            bool expected = false;
+            if (slots[i].claimed.compare_exchange_strong(expected, true)) return i;
+        }
+        throw runtime_error("too many concurrent readers");
+    }
+
+    void releaseSlot(int slot) { slots[slot].claimed.store(false); }
+
+    // Reader: run f on the latest published document
+    template <class F>
+    auto read(int slot, F&& f) const {
+        Slot& s = slots[slot];
+        s.epoch.store(globalEpoch.load());
+        const ILineStorage* doc = current.load();
+        auto result = f(*doc);
+        s.epoch.store(IDLE, memory_order_release);
+        return result;
+    }
+
+private:
+    static constexpr uint64_t IDLE = UINT64_MAX;
+
+    struct alignas(64) Slot {
+        atomic<uint64_t> epoch{IDLE};
+        atomic<bool> claimed{false};
+    };
+
+    atomic<const ILineStorage*> current{nullptr};
+    atomic<uint64_t> globalEpoch{1};
+    unique_ptr<Slot[]> slots;
+    int slotCount;
+    vector<pair<const ILineStorage*, uint64_t>> retired;    // writer only
+
+    // A copy retired at epoch E is unreachable once no reader is still in an
+    // epoch <= E: later readers load `current` after it was replaced
+    void reclaim() {
+        uint64_t oldest = IDLE;
+        for (int i = 0; i < slotCount; i++) oldest = min(oldest, slots[i].epoch.load());
+
+        size_t kept = 0;
+        for (auto& r : retired) {
+            if (r.second < oldest) delete r.first;
+            else retired[kept++] = r;
+        }
+        retired.resize(kept);
+    }
+};
+
+// ----------------------
+// CommandHistory
+// ----------------------
+// Undo/redo records live in one ring buffer and their text in one append-only
+// arena, so recording an edit does no per-command allocation. Records
+// [0, cursor) are undoable, [cursor, count) are the redo branch. Records that
+// share a group id form one undo step (a transaction).
+enum class EditKind : uint8_t { ADD, DELETE };
+
+struct EditRecord {
+    EditKind kind;
+    bool createdRow;
+    int row;
+    int col;
+    uint32_t group;
+    uint64_t textOffset;    // absolute offset into the text arena
+    uint32_t textLength;
+};
+
+class CommandHistory {
+public:
+    explicit CommandHistory(size_t byteLimit = SIZE_MAX) : limit(byteLimit) {
+        ring.resize(16);
+    }
+
+    // Drops the redo branch in O(1): its records and text are simply cut off
+    void discardRedo() {
+        if (cursor == count) return;
+        arena.resize(at(cursor).textOffset - arenaBase);
+        count = cursor;
+    }
+
+    void push(EditRecord rec, string_view text) {
+        discardRedo();
+        if (count == ring.size()) grow();
+
+        rec.textOffset = arenaBase + arena.size();
+        rec.textLength = text.size();
+        arena.append(text);
+
+        at(count++) = rec;
+        cursor = count;
+        enforceLimit();
+    }
+
+    // Newest record, if it is still the tip of history (nothing undone)
+    EditRecord* last() { return cursor == count && count > 0 ? &at(count - 1) : nullptr; }
+
+    // Grow the newest record's text; its text always sits at the arena's end
+    void appendToLast(string_view text) {
+        EditRecord& rec = at(count - 1);
+        arena.append(text);
+        rec.textLength += text.size();
+        enforceLimit();
+    }
+
+    void prependToLast(string_view text) {
+        EditRecord& rec = at(count - 1);
+        arena.insert(rec.textOffset - arenaBase, text);
+        rec.textLength += text.size();
+        enforceLimit();
+    }
+
+    EditRecord* undo() { return cursor == 0 ? nullptr : &at(--cursor); }
+    EditRecord* redo() { return cursor == count ? nullptr : &at(cursor++); }
+
+    // Next record undo()/redo() would return, without moving the cursor
+    const EditRecord* peekUndo() const { return cursor == 0 ? nullptr : &at(cursor - 1); }
+    const EditRecord* peekRedo() const { return cursor == count ? nullptr : &at(cursor); }
+
+    string_view text(const EditRecord& rec) const {
+        return string_view(arena).substr(rec.textOffset - arenaBase, rec.textLength);
+    }
+
+    void setByteLimit(size_t bytes) { limit = bytes; enforceLimit(); }
+
+    void clear() {
+        head = count = cursor = 0;
+        arena.clear();
+        arenaBase = 0;
+    }
+
+    size_t bytesUsed() const {
+        return count * sizeof(EditRecord) + (arenaBase + arena.size() - liveTextStart());
+    }
+
+private:
+    vector<EditRecord> ring;    // capacity is a power of two
+    size_t head = 0;            // ring index of the oldest record
+    size_t count = 0;
+    size_t cursor = 0;
+
+    string arena;
+    uint64_t arenaBase = 0;     // absolute offset of arena[0]
+    size_t limit;
+
+    EditRecord& at(size_t i) { return ring[(head + i) & (ring.size() - 1)]; }
+    const EditRecord& at(size_t i) const { return ring[(head + i) & (ring.size() - 1)]; }
+
+    uint64_t liveTextStart() const {
+        return count == 0 ? arenaBase + arena.size() : at(0).textOffset;
+    }
+
+    void grow() {
+        vector<EditRecord> bigger(ring.size() * 2);
+        for (size_t i = 0; i < count; i++) bigger[i] = at(i);
+        ring.swap(bigger);
+        head = 0;
+    }
+
+    // Only called below the cursor: record 0 is the oldest undoable one
+    void dropOldest() {
+        head = (head + 1) & (ring.size() - 1);
+        count--;
+        cursor--;
+    }
+
+    // Forget the oldest undo steps (whole groups) until under the byte limit;
+    // once nothing is left to undo, the redo branch goes as a whole, since
+    // trimming it from the front would break the steps that remain
+    void enforceLimit() {
+        while (count > 0 && bytesUsed() > limit) {
+            if (cursor == 0) {
+                discardRedo();
+                break;
+            }
+            uint32_t group = at(0).group;
+            dropOldest();
+            while (cursor > 0 && at(0).group == group) dropOldest();
+        }
+
+        // reclaim the dead arena prefix once it dominates (amortized O(1))
+        size_t dead = liveTextStart() - arenaBase;
+        if (dead > 0 && dead >= arena.size() / 2) {
+            arena.erase(0, dead);
+            arenaBase += dead;
+        }
+    }
 };
 
 // ----------------------
 // TextEditor
 // ----------------------
 class TextEditor {
-    friend class AddTextCommand;
-    friend class DeleteTextCommand;
-
 public:
+    explicit TextEditor(unique_ptr<ILineStorage> backend = make_unique<VectorLineStorage>())
+        : storage(std::move(backend)) {}
 
-    // 1) addText
+    // 1) addText; '\n' in text splits the row
     void addText(int row, int column, const string& text) {
-        ICommand* cmd = new AddTextCommand(*this, row, column, text);
-        cmd->apply();
-        undoStack.push(cmd);
-        clearRedo();
+        EditRecord rec{EditKind::ADD, false, row, column, 0, 0, 0};
+        applyAdd(rec, text);
+
+        EditRecord* prev = coalescable(row, text.size());
+        if (prev && !rec.createdRow && prev->kind == EditKind::ADD &&
+            column == prev->col + (int)prev->textLength &&
+            text.find('\n') == string::npos &&
+            history.text(*prev).find('\n') == string_view::npos)
+        {
+            history.appendToLast(text);     // continue the typing burst
+        } else {
+            record(rec, text);
+        }
+        markEdit();
     }
 
     // 2) deleteText
     void deleteText(int row, int startColumn, int length) {
-        ICommand* cmd = new DeleteTextCommand(*this, row, startColumn, length);
-        cmd->apply();
-        undoStack.push(cmd);
-        clearRedo();
+        EditRecord rec{EditKind::DELETE, false, row, startColumn, 0, 0, 0};
+        scratch.clear();
+        storage->erase(row, startColumn, length, scratch);
+
+        EditRecord* prev = coalescable(row, scratch.size());
+        if (prev && prev->kind == EditKind::DELETE &&
+            history.text(*prev).find('\n') == string_view::npos)
+        {
+            if (startColumn + (int)scratch.size() == prev->col) {
+                history.prependToLast(scratch);     // backspace run
+                prev->col = startColumn;
+                markEdit();
+                return;
+            }
+            if (startColumn == prev->col) {
+                history.appendToLast(scratch);      // forward-delete run
+                markEdit();
+                return;
+            }
+        }
+        record(rec, scratch);
+        markEdit();
     }
 
-    // 3) undo
+    // Delete [start, end) across rows, joining the first and last row
+    void deleteRange(int startRow, int startColumn, int endRow, int endColumn) {
+        EditRecord rec{EditKind::DELETE, false, startRow, startColumn, 0, 0, 0};
+        scratch.clear();
+        eraseRange(startRow, startColumn, endRow, endColumn, scratch);
+        record(rec, scratch);
+        burstOpen = false;
+        endEdit();
+    }
+
+    // 3) undo: reverts one step, i.e. a single edit or a whole transaction
     void undo() {
-        if (undoStack.empty()) return;
-        ICommand* cmd = undoStack.top(); undoStack.pop();
-        cmd->unapply();
-        redoStack.push(cmd);
+        if (txnDepth > 0 || !history.peekUndo()) return;
+        if (keepBranches && !history.peekRedo() && dirty)
+            snapshot();     // leaving the tip: keep it reachable as a version
+
+        EditRecord* rec = history.undo();
+        burstOpen = false;
+        dirty = true;
+
+        uint32_t group = rec->group;
+        for (;;) {
+            unapply(*rec);
+            const EditRecord* next = history.peekUndo();
+            if (!next || next->group != group) break;
+            rec = history.undo();
+        }
+        endEdit();
     }
 
     // 4) redo
     void redo() {
-        if (redoStack.empty()) return;
-        ICommand* cmd = redoStack.top(); redoStack.pop();
-        cmd->apply();
-        undoStack.push(cmd);
+        if (txnDepth > 0) return;
+        EditRecord* rec = history.redo();
+        if (!rec) return;
+        burstOpen = false;
+        dirty = true;
+
+        uint32_t group = rec->group;
+        for (;;) {
+            reapply(*rec);
+            const EditRecord* next = history.peekRedo();
+            if (!next || next->group != group) break;
+            rec = history.redo();
+        }
+        endEdit();
     }
 
     // 5) readLine
     string readLine(int row) const {
-        return rows[row];
+        return storage->line(row);
     }
 
-    int rowCount() const { return rows.size(); }
+    int rowCount() const { return storage->rowCount(); }
 
-    // Destructor: clean up all remaining commands in stacks
-    ~TextEditor() {
-        while (!undoStack.empty()) { delete undoStack.top(); undoStack.pop(); }
-        while (!redoStack.empty()) { delete redoStack.top(); redoStack.pop(); }
+    // -------- Versions --------
+    // A version is a frozen copy of the document: O(1) to take with
+    // RopeLineStorage, which shares all unchanged structure between versions.
+    // Versions form a tree through their parent ids.
+    int snapshot() {
+        versions.push_back(Version{storage->clone(), headVersion});
+        headVersion = versions.size() - 1;
+        dirty = false;
+        return headVersion;
     }
 
-private:
-    vector<string> rows;
-
-    stack<ICommand*> undoStack;
-    stack<ICommand*> redoStack;
+    // Make `version` the current document. Undo history restarts there;
+    // with keepBranches on, unsnapshotted edits are saved as a version first.
+    void checkout(int version) {
+        if (txnDepth > 0) return;
+        if (keepBranches && dirty) snapshot();
 
-    void clearRedo() {
-        while (!redoStack.empty()) {
-            delete redoStack.top();
-            redoStack.pop();
+        storage = versions[version].doc->clone();
+        if (wal) {
+            storage = make_unique<LoggedLineStorage>(std::move(storage), wal.get());
+            wal->compact(*storage);
         }
+        if (publisher) publisher->publish(storage->clone());
+        history.clear();
+        headVersion = version;
+        dirty = false;
+        burstOpen = false;
+    }
+
+    string readLine(int version, int row) const { return versions[version].doc->line(row); }
+    int rowCount(int version) const { return versions[version].doc->rowCount(); }
+    int parentVersion(int version) const { return versions[version].parent; }
+    int versionCount() const { return versions.size(); }
+
+    // When on, undoing away from the newest state snapshots it first, so a
+    // redo branch later discarded by a new edit stays reachable via checkout()
+    void setKeepBranches(bool enabled) { keepBranches = enabled; }
+
+    // -------- Durability --------
+    // Rebuild the document from the log at `path` (and its snapshot), then log
+    // every later mutation there. Call on a freshly constructed editor.
+    void openLog(const string& path, size_t groupBytes = 1 << 16) {
+        wal = make_unique<OperationLog>(path, groupBytes);
+        wal->recover(*storage);
+        storage = make_unique<LoggedLineStorage>(std::move(storage), wal.get());
+        if (publisher) publisher->publish(storage->clone());
     }
 
-    // -------- AddTextCommand --------
-    class AddTextCommand : public ICommand {
+    // Make every finished edit durable now instead of at the next group write
+    void sync() { if (wal) wal->sync(); }
+
+    // -------- Concurrent readers --------
+    // Handle for one reader thread. Each read sees the document as of the
+    // latest finished edit (or committed transaction) and never blocks the
+    // writer or other readers. Readers must not outlive the editor.
+    class Reader {
     public:
-        AddTextCommand(TextEditor& ed, int r, int c, const string& t)
-            : editor(ed), row(r), col(c), text(t) {}
-
-        void apply() override {
-            createdRow = false;
-            if (row == (int)editor.rows.size()) {
-                editor.rows.emplace_back("");  // create new row
-                createdRow = true;
-            }
-            editor.rows[row].insert(col, text);
+        Reader(Reader&& o) noexcept : pub(o.pub), slot(o.slot) { o.pub = nullptr; }
+        Reader(const Reader&) = delete;
+        ~Reader() { if (pub) pub->releaseSlot(slot); }
+
+        string readLine(int row) const {
+            return pub->read(slot, [row](const ILineStorage& d) { return d.line(row); });
         }
 
-        void unapply() override {
-            editor.rows[row].erase(col, text.size());
-            if (createdRow &&
-                row == (int)editor.rows.size() - 1 &&
-                editor.rows[row].empty()) 
-            {
-                editor.rows.pop_back();
-            }
+        int rowCount() const {
+            return pub->read(slot, [](const ILineStorage& d) { return d.rowCount(); });
         }
 
     private:
-        TextEditor& editor;
-        int row;
-        int col;
-        string text;
-        bool createdRow = false;
+        friend class TextEditor;
+        Reader(ReadPublisher* p, int s) : pub(p), slot(s) {}
+
+        ReadPublisher* pub;
+        int slot;
     };
 
-    // -------- DeleteTextCommand --------
-    class DeleteTextCommand : public ICommand {
-    public:
-        DeleteTextCommand(TextEditor& ed, int r, int c, int len)
-            : editor(ed), row(r), col(c), length(len) {}
+    // Start publishing a frozen copy after every edit. Each publish is O(1)
+    // with RopeLineStorage but a full copy with VectorLineStorage.
+    void enableConcurrentReads(int maxReaders = 64) {
+        publisher = make_unique<ReadPublisher>(maxReaders);
+        publisher->publish(storage->clone());
+    }
+
+    // Thread-safe; call from the reader thread
+    Reader openReader() { return Reader(publisher.get(), publisher->acquireSlot()); }
 
-        void apply() override {
-            removed = editor.rows[row].substr(col, length);
-            editor.rows[row].erase(col, length);
+    // -------- Transactions --------
+    // Edits between begin and commit undo/redo as one step. Nested begins
+    // join the outermost transaction.
+    void beginTransaction() {
+        if (txnDepth++ == 0) {
+            txnGroup = ++nextGroup;
+            burstOpen = false;
         }
+    }
 
-        void unapply() override {
-            editor.rows[row].insert(col, removed);
+    void commitTransaction() {
+        if (txnDepth == 0) return;
+        if (--txnDepth == 0) {
+            burstOpen = false;
+            endEdit();
         }
+    }
 
-    private:
-        TextEditor& editor;
-        int row;
-        int col;
-        int length;
-        string removed;
+    // Revert everything applied since the outermost beginTransaction()
+    void rollbackTransaction() {
+        if (txnDepth == 0) return;
+        txnDepth = 0;
+        burstOpen = false;
+
+        bool reverted = false;
+        while (const EditRecord* top = history.peekUndo()) {
+            if (top->group != txnGroup) break;
+            unapply(*history.undo());
+            reverted = true;
+        }
+        if (reverted) history.discardRedo();
+        endEdit();
+    }
+
+    // Cap on history memory; the oldest undo steps are dropped beyond it
+    void setHistoryLimit(size_t bytes) { history.setByteLimit(bytes); }
+
+    // Fold consecutive inserts/deletes on the same row into one undo step
+    // while they arrive within `window` and stay under `maxChars`
+    void setCoalescing(bool enabled,
+                       chrono::milliseconds window = chrono::milliseconds(1000),
+                       size_t maxChars = 4096)
+    {
+        coalesce = enabled;
+        coalesceWindow = window;
+        coalesceMaxChars = maxChars;
+        burstOpen = false;
+    }
+
+    // Force the next edit to start a new undo step
+    void breakCoalescing() { burstOpen = false; }
+
+private:
+    struct Version {
+        shared_ptr<const ILineStorage> doc;
+        int parent;
     };
+
+    unique_ptr<ReadPublisher> publisher;
+    unique_ptr<OperationLog> wal;   // outlives the LoggedLineStorage using it
+    unique_ptr<ILineStorage> storage;
+    CommandHistory history;
+    string scratch;             // reused sink for erased text
+
+    vector<Version> versions;
+    int headVersion = -1;       // version the current document descends from
+    bool keepBranches = false;
+    bool dirty = false;         // edited since the last snapshot/checkout
+
+    uint32_t nextGroup = 0;
+    uint32_t txnGroup = 0;
+    int txnDepth = 0;
+
+    bool coalesce = false;
+    chrono::milliseconds coalesceWindow{1000};
+    size_t coalesceMaxChars = 4096;
+    bool burstOpen = false;     // the newest record may still absorb edits
+    chrono::steady_clock::time_point lastEdit;
+
+    void record(EditRecord& rec, string_view text) {
+        rec.group = txnDepth > 0 ? txnGroup : ++nextGroup;
+        history.push(rec, text);
+        dirty = true;
+    }
+
+    // Newest record if an edit of `len` chars on `row` may merge into it
+    EditRecord* coalescable(int row, size_t len) {
+        if (!coalesce || !burstOpen || txnDepth > 0) return nullptr;
+        if (chrono::steady_clock::now() - lastEdit > coalesceWindow) return nullptr;
+
+        EditRecord* prev = history.last();
+        if (!prev || prev->row != row) return nullptr;
+        if (prev->textLength + len > coalesceMaxChars) return nullptr;
+        return prev;
+    }
+
+    void markEdit() {
+        dirty = true;
+        burstOpen = txnDepth == 0;
+        if (coalesce) lastEdit = chrono::steady_clock::now();
+        endEdit();
+    }
+
+    // Close the log frame of the edit just applied (a transaction is one frame)
+    // and publish the result to concurrent readers
+    void endEdit() {
+        if (txnDepth > 0) return;
+        if (wal) {
+            wal->endEdit();
+            if (wal->wantsCompaction()) wal->compact(*storage);
+        }
+        if (publisher) publisher->publish(storage->clone());
+    }
+
+    // Position just past `text` when it is inserted at (row, col)
+    static pair<int, int> endOf(int row, int col, string_view text) {
+        size_t nl = text.rfind('\n');
+        if (nl == string_view::npos) return {row, col + (int)text.size()};
+        return {row + (int)count(text.begin(), text.end(), '\n'),
+                (int)(text.size() - nl - 1)};
+    }
+
+    void insertText(int row, int col, string_view text) {
+        size_t nl = text.find('\n');
+        if (nl == string_view::npos) {
+            storage->insert(row, col, text);
+            return;
+        }
+
+        // split the row at col, then add all new rows in one block
+        string tail;
+        storage->erase(row, col, INT_MAX, tail);
+        storage->insert(row, col, text.substr(0, nl));
+
+        vector<string> lines;
+        size_t start = nl + 1;
+        for (;;) {
+            size_t next = text.find('\n', start);
+            if (next == string_view::npos) break;
+            lines.emplace_back(text.substr(start, next - start));
+            start = next + 1;
+        }
+        lines.emplace_back(text.substr(start));
+        lines.back() += tail;
+        storage->insertRows(row + 1, lines);
+    }
+
+    void eraseRange(int r1, int c1, int r2, int c2, string& removed) {
+        if (r1 == r2) {
+            storage->erase(r1, c1, c2 - c1, removed);
+            return;
+        }
+
+        storage->erase(r1, c1, INT_MAX, removed);
+        for (int r = r1 + 1; r < r2; r++) {
+            removed += '\n';
+            removed += storage->line(r);
+        }
+        removed += '\n';
+
+        string tail;
+        storage->erase(r2, 0, c2, removed);
+        storage->erase(r2, 0, INT_MAX, tail);
+        storage->eraseRows(r1 + 1, r2 - r1);
+        storage->insert(r1, c1, tail);
+    }
+
+    void applyAdd(EditRecord& rec, string_view text) {
+        rec.createdRow = false;
+        if (rec.row == storage->rowCount()) {
+            storage->insertRows(rec.row, {""});   // create new row
+            rec.createdRow = true;
+        }
+        insertText(rec.row, rec.col, text);
+    }
+
+    void unapply(const EditRecord& rec) {
+        string_view text = history.text(rec);
+        if (rec.kind == EditKind::DELETE) {
+            insertText(rec.row, rec.col, text);
+            return;
+        }
+
+        auto [endRow, endCol] = endOf(rec.row, rec.col, text);
+        scratch.clear();
+        eraseRange(rec.row, rec.col, endRow, endCol, scratch);
+        if (rec.createdRow &&
+            rec.row == storage->rowCount() - 1 &&
+            storage->lineLength(rec.row) == 0)
+        {
+            storage->eraseRows(rec.row, 1);
+        }
+    }
+
+    void reapply(EditRecord& rec) {
+        string_view text = history.text(rec);
+        if (rec.kind == EditKind::ADD) {
+            applyAdd(rec, text);
+            return;
+        }
+
+        auto [endRow, endCol] = endOf(rec.row, rec.col, text);
+        scratch.clear();
+        eraseRange(rec.row, rec.col, endRow, endCol, scratch);
+    }
 };